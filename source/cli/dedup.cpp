@@ -0,0 +1,84 @@
+#include "dedup.hpp"
+#include "../util/file.hpp"
+#include "../util/hash.hpp"
+#include <map>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <cstdint>
+#include <sys/stat.h>
+
+namespace cctt
+{
+    namespace cli
+    {
+        auto find_identical_inputs(std::vector<std::string> const& paths) -> std::vector<Identical_Inputs>
+        {
+            std::vector<Identical_Inputs> inputs(paths.size());
+            for (std::size_t i=0; i < paths.size(); i++)
+                inputs[i] = {i, i};
+
+            // The same files, by device and inode.
+            std::map<std::pair<dev_t, ino_t>, std::size_t> files;
+
+            // The first path of each file, by size, in order.
+            std::map<off_t, std::vector<std::size_t>> sizes;
+
+            for (std::size_t i=0; i < paths.size(); i++) {
+                struct stat st;
+                if (::stat(paths[i].data(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+
+                auto file = files.emplace(std::make_pair(st.st_dev, st.st_ino), i);
+                if (!file.second) inputs[i].first = file.first->second;
+                else sizes[st.st_size].push_back(i);
+            }
+
+            // Copies, among files of the same size.
+            // Contents are kept for the files of one size at a time, to tell hash collisions apart.
+            std::vector<std::string> contents;
+            std::unordered_multimap<std::uint64_t, std::size_t> hashes;
+
+            for (auto& same_size: sizes) {
+                auto& indices = same_size.second;
+                if (indices.size() < 2) continue;
+
+                contents.clear();
+                contents.resize(indices.size());
+                hashes.clear();
+
+                for (std::size_t j=0; j < indices.size(); j++) {
+                    try {
+                        util::slurp(paths[indices[j]].data(), contents[j]);
+                    }
+                    catch (std::runtime_error const&) {
+                        continue;
+                    }
+
+                    auto hash = util::hash64(contents[j].data(), contents[j].size());
+                    auto same = hashes.equal_range(hash);
+                    for (auto it=same.first; it != same.second; ++it) {
+                        if (contents[it->second] == contents[j]) {
+                            inputs[indices[j]].first = indices[it->second];
+                            break;
+                        }
+                    }
+
+                    if (inputs[indices[j]].first == indices[j]) hashes.emplace(hash, j);
+                }
+            }
+
+            // Links of copies belong to the group of the first copy, which comes before them.
+            for (std::size_t i=0; i < inputs.size(); i++)
+                inputs[i].first = inputs[inputs[i].first].first;
+
+            for (std::size_t i=0; i < inputs.size(); i++)
+                inputs[inputs[i].first].last = i;
+
+            for (std::size_t i=0; i < inputs.size(); i++)
+                inputs[i].last = inputs[inputs[i].first].last;
+
+            return inputs;
+        }
+    }
+}
+
@@ -0,0 +1,26 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstddef>
+
+namespace cctt
+{
+    namespace cli
+    {
+        // The paths of a batch with the same contents as a path,
+        // through symlinks or hard links to the same file, or through copies.
+        struct Identical_Inputs final
+        {
+            std::size_t first;      // index of the first path with the same contents
+            std::size_t last;       // index of the last one
+        };
+
+        // Group paths by their contents, returning the group of each path.
+        // Paths that are not regular files, or cannot be read, are left alone,
+        // so that their errors show when they are processed.
+        //
+        // Only files of the same size are read and hashed, then compared.
+        auto find_identical_inputs(std::vector<std::string> const& paths) -> std::vector<Identical_Inputs>;
+    }
+}
+
@@ -0,0 +1,238 @@
+#include "includes.hpp"
+#include "process.hpp"
+#include "../token-tree/error.hpp"
+#include "../util/file.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <cstdlib>
+#include <sys/stat.h>
+
+#include "../util/style.inl"
+
+namespace cctt
+{
+    namespace cli
+    {
+        namespace
+        {
+            auto is_file(std::string const& path) -> bool
+            {
+                struct stat st;
+                return (::stat(path.data(), &st) == 0 && S_ISREG(st.st_mode));
+            }
+
+            auto real_path_of(std::string const& path) -> std::string
+            {
+                auto real = ::realpath(path.data(), nullptr);
+                if (real == nullptr) return path;
+
+                std::string result{real};
+                std::free(real);
+                return result;
+            }
+
+            // A file of the include closure, with its outputs until they are written in order.
+            struct Included_File final
+            {
+                std::string path;
+                std::string out;
+                std::string err;
+
+                // Indices of the files it includes, in the order of their directives.
+                std::vector<std::size_t> includes;
+            };
+
+            // Files to scan, and the table of those already found, shared by the threads.
+            struct Include_Closure final
+            {
+                // Add path, unless found already. Returns the index of its file.
+                // Assumes: the lock is held.
+                auto add(std::string path, std::string key) -> std::size_t
+                {
+                    auto found = scanned.emplace(std::move(key), files.size());
+                    if (!found.second) return found.first->second;
+
+                    files.emplace_back();
+                    files.back().path = std::move(path);
+                    pending.push_back(files.size() - 1);
+                    ready.notify_one();
+                    return files.size() - 1;
+                }
+
+                // Returns false when every file is done.
+                auto pop(std::unique_lock<std::mutex>& lock, std::size_t& index) -> bool
+                {
+                    ready.wait(lock, [this] { return (!pending.empty() || busy == 0); });
+                    if (pending.empty()) return false;
+
+                    index = pending.front();
+                    pending.pop_front();
+                    busy++;
+                    return true;
+                }
+
+                // includes are the real paths of the files that the file at index includes.
+                auto done(std::size_t index, std::vector<std::string> const& includes) -> void
+                {
+                    std::lock_guard<std::mutex> lock{mutex};
+
+                    for (auto& path: includes)
+                        files[index].includes.push_back(add(path, path));
+
+                    // The last file done wakes up every thread to finish.
+                    if (--busy == 0 && pending.empty()) ready.notify_all();
+                }
+
+                std::mutex mutex;
+                std::condition_variable ready;
+
+                // References to files stay valid as files are added.
+                std::deque<Included_File> files;
+                std::unordered_map<std::string, std::size_t> scanned;
+                std::deque<std::size_t> pending;
+                std::size_t busy{};
+            };
+
+            auto scan_included_files(Options const& opts, Include_Closure& closure) -> void
+            {
+                // Reused across files, so that their memory is allocated only once.
+                std::string source;
+                Token_Tree tt;
+                Token_Tree_Diagnostics diagnostics;
+                std::vector<std::string> includes;
+
+                std::unique_lock<std::mutex> lock{closure.mutex};
+                std::size_t index;
+
+                while (closure.pop(lock, index)) {
+                    auto& file = closure.files[index];
+                    lock.unlock();
+
+                    std::ostringstream out;
+                    std::ostringstream err;
+                    includes.clear();
+
+                    try {
+                        util::slurp(file.path.data(), source);
+
+                        if (build_token_tree(opts, file.path, source, tt, diagnostics, nullptr, err)) {
+                            write_path_header(opts, file.path, out);
+                            write_outputs(opts, file.path, tt, out, err);
+
+                            for (auto& include: tt.includes()) {
+                                auto path = resolve_include(file.path, include, opts.include_dirs);
+                                if (!path.empty()) includes.push_back(real_path_of(path));
+                            }
+                        }
+                    }
+                    catch (std::exception const& e) {
+                        err << STYLE_ERROR << e.what() << STYLE_NORMAL << "\n";
+                    }
+
+                    file.out = out.str();
+                    file.err = err.str();
+                    closure.done(index, includes);
+
+                    lock.lock();
+                }
+            }
+        }
+
+        auto resolve_include(std::string const& path, Include_Directive const& include, std::vector<std::string> const& include_dirs) -> std::string
+        {
+            std::string name{include.first, include.last};
+            if (name[0] == '/') return (is_file(name) ? name : "");
+
+            if (!include.is_angled) {
+                auto slash = path.rfind('/');
+                auto relative = (slash == std::string::npos ? name : path.substr(0, slash + 1) + name);
+                if (is_file(relative)) return relative;
+            }
+
+            for (auto& dir: include_dirs) {
+                auto candidate = dir + "/" + name;
+                if (is_file(candidate)) return candidate;
+            }
+
+            return "";
+        }
+
+        auto write_includes(std::string const& path, Token_Tree const& tt, std::vector<std::string> const& include_dirs, std::ostream& out) -> void
+        {
+            for (auto& include: tt.includes()) {
+                auto loc = tt.source_location_of(include.directive);
+                auto open = (include.is_angled ? '<' : '"');
+                auto closing = (include.is_angled ? '>' : '"');
+
+                out
+                    << STYLE_PATH << path << STYLE_NORMAL ":" STYLE_LOCATION << loc.line << ":" << loc.column << STYLE_NORMAL
+                    << " #include " STYLE_SOURCE << open;
+                out.write(include.first, include.last - include.first);
+                out << closing << STYLE_NORMAL;
+
+                auto resolved = resolve_include(path, include, include_dirs);
+                if (resolved.empty()) out << " (not found)\n";
+                else out << " -> " STYLE_PATH << resolved << STYLE_NORMAL "\n";
+            }
+
+            out.flush();
+        }
+
+        auto run_follow_includes(Options const& opts) -> void
+        {
+            Include_Closure closure;
+            std::vector<std::size_t> roots;
+
+            // Paths are named as given, but found again through includes by their real paths.
+            // Like included files, they must be regular files.
+            for (auto& path: opts.paths) {
+                if (is_file(path)) roots.push_back(closure.add(path, real_path_of(path)));
+                else std::clog << STYLE_ERROR "Cannot load file: " << path << STYLE_NORMAL "\n";
+            }
+            std::clog.flush();
+
+            auto workers = opts.workers;
+            if (workers == 0) workers = std::max(1u, std::thread::hardware_concurrency());
+
+            // If a thread cannot be started, the others still finish the closure.
+            std::vector<std::thread> threads;
+            threads.reserve(workers);
+            try {
+                for (unsigned i=0; i < workers; i++)
+                    threads.emplace_back([&] { scan_included_files(opts, closure); });
+            }
+            catch (std::system_error const&) {
+                if (threads.empty()) throw;
+            }
+            for (auto& thread: threads)
+                thread.join();
+
+            // Depth-first, each file once.
+            std::vector<bool> written(closure.files.size());
+            std::vector<std::size_t> stack{roots.rbegin(), roots.rend()};
+
+            while (!stack.empty()) {
+                auto index = stack.back();
+                stack.pop_back();
+                if (written[index]) continue;
+                written[index] = true;
+
+                auto& file = closure.files[index];
+                std::cout.write(file.out.data(), std::streamsize(file.out.size()));
+                std::cout.flush();
+                std::clog.write(file.err.data(), std::streamsize(file.err.size()));
+                std::clog.flush();
+
+                stack.insert(stack.end(), file.includes.rbegin(), file.includes.rend());
+            }
+        }
+    }
+}
+
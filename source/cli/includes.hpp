@@ -0,0 +1,31 @@
+#pragma once
+#include "options.hpp"
+#include "../token-tree/token-tree.hpp"
+#include <string>
+#include <vector>
+#include <iostream>
+
+namespace cctt
+{
+    namespace cli
+    {
+        // Find the file that include, a directive of the file at path, names:
+        // "name" is looked up in the directory of path first, then like <name>, in include_dirs in order.
+        // Returns "" if there is none, e.g. for the headers of the standard library.
+        auto resolve_include(std::string const& path, Include_Directive const& include, std::vector<std::string> const& include_dirs) -> std::string;
+
+        // Print the include directives of tt, the tree of path, with the files they resolve to.
+        // tt must have recorded them (see Token_Tree::record_includes()).
+        auto write_includes(std::string const& path, Token_Tree const& tt, std::vector<std::string> const& include_dirs, std::ostream& out) -> void;
+
+        // Process opts.paths, and the files they include through opts.include_dirs, transitively.
+        //
+        // Files are scanned by opts.workers threads (0 means all hardware threads), which share a table of the files
+        // already scanned, by their real paths; thus each file is read and scanned once, however often it is included.
+        // Outputs are written when all files are done, in the order of their first inclusion, depth-first from paths,
+        // each after its path (see write_path_header()).
+        // Included files are named by their real paths.
+        auto run_follow_includes(Options const& opts) -> void;
+    }
+}
+
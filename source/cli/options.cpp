@@ -0,0 +1,187 @@
+#include "options.hpp"
+#include <stdexcept>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+
+namespace cctt
+{
+    namespace cli
+    {
+        namespace
+        {
+            // If arg is "--name=value", returns value; otherwise returns nullptr.
+            template <std::size_t len>
+            auto value_of(char const* arg, char const (&name)[len]) -> char const*
+            {
+                if (std::strncmp(arg, name, len - 1) != 0) return nullptr;
+                if (arg[len - 1] != '=') return nullptr;
+                return arg + len;
+            }
+        }
+
+        auto is_connect_option(char const* arg) -> bool
+        {
+            return (value_of(arg, "--connect") != nullptr);
+        }
+
+        auto parse_options(int argc, char* argv[]) -> Options
+        {
+            Options opts;
+            auto has_format = false;
+            auto has_jobs = false;
+            auto only_paths = false;
+
+            for (int i=1; i < argc; i++) {
+                auto arg = argv[i];
+
+                if (only_paths || arg[0] != '-' || arg[1] == '\0') {
+                    opts.paths.emplace_back(arg);
+                    continue;
+                }
+
+                if (std::strcmp(arg, "--") == 0) {
+                    only_paths = true;
+                    continue;
+                }
+
+                if (auto format = value_of(arg, "--format")) {
+                    has_format = true;
+                    if (std::strcmp(format, "dump") == 0) opts.dump = true;
+                    else if (std::strcmp(format, "json") == 0) opts.json = true;
+                    else if (std::strcmp(format, "binary") == 0) opts.binary = true;
+                    else if (std::strcmp(format, "reflect") == 0) opts.reflect = true;
+                    else if (std::strcmp(format, "tree") == 0) opts.tree = true;
+                    else if (std::strcmp(format, "includes") == 0) opts.includes = true;
+                    else throw std::runtime_error{"Unknown format: " + std::string{format}};
+                    continue;
+                }
+
+                if (std::strcmp(arg, "--nested") == 0) {
+                    opts.nested = true;
+                    continue;
+                }
+
+                if (auto dir = value_of(arg, "--cache-dir")) {
+                    if (*dir == '\0') throw std::runtime_error{"Invalid cache directory: " + std::string{dir}};
+                    opts.cache_dir = dir;
+                    continue;
+                }
+
+                if (auto size = value_of(arg, "--cache-size")) {
+                    char* end;
+                    auto n = std::strtoull(size, &end, 10);
+                    if (!std::isdigit(static_cast<unsigned char>(*size)) || *end != '\0') throw std::runtime_error{"Invalid cache size: " + std::string{size}};
+                    opts.cache_size_mib = n;
+                    continue;
+                }
+
+                if (auto name = value_of(arg, "--publish")) {
+                    if (name[0] != '/' || name[1] == '\0' || std::strchr(name + 1, '/'))
+                        throw std::runtime_error{"Invalid shared memory name: " + std::string{name}};
+                    opts.publish = name;
+                    continue;
+                }
+
+                if (auto socket = value_of(arg, "--serve")) {
+                    if (*socket == '\0') throw std::runtime_error{"Invalid socket: " + std::string{socket}};
+                    opts.serve = socket;
+                    continue;
+                }
+
+                if (auto socket = value_of(arg, "--connect")) {
+                    if (*socket == '\0') throw std::runtime_error{"Invalid socket: " + std::string{socket}};
+                    opts.connect = socket;
+                    continue;
+                }
+
+                if (auto workers = value_of(arg, "--workers")) {
+                    char* end;
+                    auto n = std::strtoul(workers, &end, 10);
+                    if (!std::isdigit(static_cast<unsigned char>(*workers)) || *end != '\0') throw std::runtime_error{"Invalid number of workers: " + std::string{workers}};
+                    opts.workers = unsigned(n);
+                    continue;
+                }
+
+                if (auto path = value_of(arg, "--diff")) {
+                    if (*path == '\0') throw std::runtime_error{"Invalid path to diff from: " + std::string{path}};
+                    opts.diff_from = path;
+                    continue;
+                }
+
+                if (std::strcmp(arg, "--watch") == 0) {
+                    opts.watch = true;
+                    continue;
+                }
+
+                if (std::strcmp(arg, "--follow-includes") == 0) {
+                    opts.follow_includes = true;
+                    continue;
+                }
+
+                if (std::strncmp(arg, "-I", 2) == 0) {
+                    if (arg[2] == '\0') throw std::runtime_error{"-I requires a directory, as in -IDIR"};
+                    opts.include_dirs.emplace_back(arg + 2);
+                    continue;
+                }
+
+                if (std::strcmp(arg, "--recover") == 0) {
+                    opts.recover = true;
+                    continue;
+                }
+
+                if (auto jobs = value_of(arg, "--jobs")) {
+                    char* end;
+                    auto n = std::strtoul(jobs, &end, 10);
+                    if (!std::isdigit(static_cast<unsigned char>(*jobs)) || *end != '\0') throw std::runtime_error{"Invalid number of jobs: " + std::string{jobs}};
+                    opts.jobs = unsigned(n);
+                    has_jobs = true;
+                    continue;
+                }
+
+                if (auto lines = value_of(arg, "--lines")) {
+                    char* end;
+                    auto first = std::strtoul(lines, &end, 10);
+                    auto last = first;
+                    if (*end == ':') last = std::strtoul(end + 1, &end, 10);
+                    if (!std::isdigit(static_cast<unsigned char>(*lines)) || *end != '\0' || first == 0 || last < first)
+                        throw std::runtime_error{"Invalid line range: " + std::string{lines}};
+                    opts.first_line = first;
+                    opts.last_line = last;
+                    continue;
+                }
+
+                if (auto block = value_of(arg, "--block")) {
+                    if (*block == '\0') throw std::runtime_error{"Invalid block: " + std::string{block}};
+                    opts.block = block;
+                    continue;
+                }
+
+                throw std::runtime_error{"Unknown option: " + std::string{arg}};
+            }
+
+            if (opts.first_line != 0 && !opts.block.empty()) throw std::runtime_error{"--lines and --block cannot be used together"};
+            if (!opts.serve.empty() && !opts.connect.empty()) throw std::runtime_error{"--serve and --connect cannot be used together"};
+            if (opts.watch && opts.paths.empty()) throw std::runtime_error{"--watch requires paths to watch"};
+            if ((opts.watch || opts.follow_includes) && opts.tree)
+                throw std::runtime_error{"--format=tree cannot be used with --watch or --follow-includes, as it does not name files"};
+            if (opts.watch && (!opts.serve.empty() || !opts.connect.empty() || !opts.publish.empty()))
+                throw std::runtime_error{"--watch cannot be used with --serve, --connect or --publish"};
+            if (opts.follow_includes && opts.paths.empty()) throw std::runtime_error{"--follow-includes requires paths to start from"};
+            if (opts.follow_includes && (opts.watch || !opts.serve.empty() || !opts.connect.empty() || !opts.publish.empty() || !opts.diff_from.empty()))
+                throw std::runtime_error{"--follow-includes cannot be used with --watch, --serve, --connect, --publish or --diff"};
+            if (!opts.diff_from.empty() && (opts.json || opts.binary || opts.reflect || opts.tree))
+                throw std::runtime_error{"--diff cannot be used with --format=json, binary, reflect or tree, whose outputs its lines would corrupt"};
+            if (!has_format && opts.publish.empty() && opts.diff_from.empty()) opts.dump = true;
+
+            // Options of the token tree printer.
+            if (!opts.dump && has_jobs) throw std::runtime_error{"--jobs requires the dump output (--format=dump)"};
+            if (!opts.dump && opts.nested) throw std::runtime_error{"--nested requires the dump output (--format=dump)"};
+            if (!opts.dump && opts.first_line != 0) throw std::runtime_error{"--lines requires the dump output (--format=dump)"};
+            if (!opts.dump && !opts.block.empty()) throw std::runtime_error{"--block requires the dump output (--format=dump)"};
+
+            return opts;
+        }
+    }
+}
+
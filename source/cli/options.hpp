@@ -0,0 +1,86 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstddef>      // for std::size_t
+#include <cstdint>
+
+namespace cctt
+{
+    namespace cli
+    {
+        struct Options final
+        {
+            // Print the token tree and the human-readable introspection dump.
+            bool dump{};
+
+            // Export introspection results in machine-readable formats.
+            bool json{};
+            bool binary{};
+
+            // Generate a C++ header with compile-time reflection data.
+            bool reflect{};
+
+            // Write the token tree in the memory-mappable format of token-tree/mapped.hpp.
+            bool tree{};
+
+            // Print the `#include` directives, with the files they resolve to (see cli/includes.hpp).
+            bool includes{};
+
+            // Number of threads for printing the token tree; 0 means all hardware threads.
+            unsigned jobs{1};
+
+            // Print the token tree depth-first and indented, instead of breadth-first.
+            bool nested{};
+
+            // Print only a part of the token tree:
+            // the innermost block enclosing lines [first_line, last_line] (1-based), or the block with the given link.
+            // first_line == 0 means no line range.
+            std::size_t first_line{};
+            std::size_t last_line{};
+            std::string block;
+
+            // Report all scanning and pairing errors, and go on with a recovered token tree.
+            bool recover{};
+
+            // Directory of cached token trees, keyed by the hashes of sources; empty means no cache.
+            // The cache is not used with recover.
+            std::string cache_dir;
+            std::uint64_t cache_size_mib{256};
+
+            // Publish the token trees of all files in this POSIX shared memory object (see token-tree/shared.hpp).
+            // Other outputs are written only if asked by --format.
+            std::string publish;
+
+            // Print the blocks that changed from this file to each path (see token-tree/merkle.hpp).
+            // Other outputs are written only if asked by --format, which must be a text format (dump or includes).
+            std::string diff_from;
+
+            // Process paths again whenever they change (see cli/watch.hpp). Paths may be directories.
+            bool watch{};
+
+            // Also process every file that paths include, transitively, each once (see cli/includes.hpp).
+            bool follow_includes{};
+
+            // Directories to look up included files in, in order, as given by -I.
+            std::vector<std::string> include_dirs;
+
+            // Serve requests on this Unix domain socket (see cli/server.hpp), with this many worker threads;
+            // 0 means all hardware threads. The threads of follow_includes are set the same way.
+            std::string serve;
+            unsigned workers{};
+
+            // Send the other arguments to the server on this Unix domain socket, and print its outputs.
+            std::string connect;
+
+            // When empty, the builtin test source is used.
+            std::vector<std::string> paths;
+        };
+
+        // Whether arg is the --connect option, which the client does not pass on to the server.
+        auto is_connect_option(char const* arg) -> bool;
+
+        // Throws std::runtime_error on invalid arguments.
+        auto parse_options(int argc, char* argv[]) -> Options;
+    }
+}
+
@@ -0,0 +1,165 @@
+#include "process.hpp"
+#include "includes.hpp"
+#include "../token-tree/pretty-print.hpp"
+#include "../token-tree/region.hpp"
+#include "../token-tree/mapped.hpp"
+#include "../token-tree/merkle.hpp"
+#include "../introspection/introspect.hpp"
+#include "../introspection/multiplex.hpp"
+#include "../introspection/dump.hpp"
+#include "../introspection/export.hpp"
+#include "../introspection/reflect.hpp"
+
+#include "../util/style.inl"
+
+namespace cctt
+{
+    namespace cli
+    {
+        auto report_parsing_error(std::ostream& err, std::string const& path, char const* what) -> void
+        {
+            err
+                << STYLE_ERROR "Error" STYLE_NORMAL " parsing "
+                << STYLE_PATH << path << STYLE_NORMAL
+                << " at " << what
+                << "\n";
+            err.flush();
+        }
+
+        auto report_diagnostics(std::ostream& err, std::string const& path, Token_Tree_Diagnostics const& diagnostics) -> void
+        {
+            for (auto& e: diagnostics.errors)
+                report_parsing_error(err, path, e.message().data());
+            if (diagnostics.dropped != 0)
+                err << diagnostics.dropped << " more errors in " STYLE_PATH << path << STYLE_NORMAL "\n";
+            err.flush();
+        }
+
+        auto build_token_tree(
+            Options const& opts,
+            std::string const& path,
+            std::string const& source,
+            Token_Tree& tt,
+            Token_Tree_Diagnostics& diagnostics,
+            Token_Tree_Cache* cache,
+            std::ostream& err
+        ) -> bool
+        {
+            // Trees from the cache have no include directives.
+            auto needs_includes = (opts.includes || opts.follow_includes);
+            tt.record_includes(needs_includes);
+            if (needs_includes) cache = nullptr;
+
+            if (opts.recover) {
+                diagnostics.clear();
+                tt.reset_with_recovery(source.data(), diagnostics);
+                report_diagnostics(err, path, diagnostics);
+                return true;
+            }
+
+            if (cache && cache->load(tt, source)) return true;
+
+            Token_Tree_Error error;
+            if (!tt.try_reset(source.data(), error)) {
+                report_parsing_error(err, path, error.message().data());
+                return false;
+            }
+
+            if (cache) cache->store(tt, source);
+            return true;
+        }
+
+        auto write_diff(
+            std::string const& old_path,
+            Token_Tree const& old_tt,
+            std::string const& path,
+            Token_Tree const& tt,
+            std::ostream& out
+        ) -> void
+        {
+            Token_Tree_Hashes old_hashes{old_tt};
+            Token_Tree_Hashes hashes{tt};
+
+            std::vector<Token_Tree_Change> changes;
+            diff_token_trees(old_tt, old_hashes, tt, hashes, changes);
+
+            // "line:column" of the first token, or "first-last" with the last character of the last token.
+            auto write_range = [&] (Token_Tree const& tt, std::string const& path, Token const* first, Token const* last) {
+                auto start = tt.source_location_of(first->first);
+                out << STYLE_PATH << path << STYLE_NORMAL ":" STYLE_LOCATION << start.line << ":" << start.column;
+
+                if (first != last) {
+                    auto end = tt.source_location_of(last[-1].last - 1);
+                    out << "-" << end.line << ":" << end.column;
+                }
+
+                out << STYLE_NORMAL;
+            };
+
+            for (auto& change: changes) {
+                write_range(old_tt, old_path, change.old_first, change.old_last);
+                out << " -> ";
+                write_range(tt, path, change.new_first, change.new_last);
+                out << "\n";
+            }
+
+            out.flush();
+        }
+
+        auto write_path_header(Options const& opts, std::string const& path, std::ostream& out) -> void
+        {
+            // A comment, as --format=reflect writes C++.
+            if (opts.dump || opts.reflect) out << "// " << path << "\n";
+        }
+
+        auto write_outputs(
+            Options const& opts,
+            std::string const& path,
+            Token_Tree const& tt,
+            std::ostream& out,
+            std::ostream& err,
+            Introspection_Tape* tape
+        ) -> void
+        {
+            try {
+                if (opts.dump) {
+                    auto open = (Token const*) nullptr;
+                    if (opts.first_line != 0) open = find_block_by_lines(tt, opts.first_line, opts.last_line);
+                    else if (!opts.block.empty()) open = find_block_by_link(tt, opts.block.data());
+
+                    if (opts.nested) pretty_print_token_subtree_nested(tt.begin(), open, tt.end(), out);
+                    else pretty_print_token_subtree_parallel(tt.begin(), open, tt.end(), opts.jobs, out);
+                    out.flush();
+                }
+
+                if (opts.tree) {
+                    std::string tree_file;
+                    save_mapped_token_tree(tt, tree_file);
+                    out.write(tree_file.data(), std::streamsize(tree_file.size()));
+                    out.flush();
+                }
+
+                if (opts.includes) write_includes(path, tt, opts.include_dirs, out);
+
+                Introspection_Dumper dumper{out};
+                Introspection_Exporter json{tt, path, Export_Format::json, out};
+                Introspection_Exporter binary{tt, path, Export_Format::binary, out};
+                Reflection_Generator reflect{out};
+
+                Introspection_Multiplexer handler;
+                if (opts.dump) handler.add(dumper);
+                if (opts.json) handler.add(json);
+                if (opts.binary) handler.add(binary);
+                if (opts.reflect) handler.add(reflect);
+
+                if (tape == nullptr) introspect(tt, handler);
+                else if (tape->is_empty()) record_introspection(tt, handler, *tape);
+                else replay_introspection(tt, *tape, handler);
+            }
+            catch (Parsing_Error const& e) {
+                report_parsing_error(err, path, e.what());
+            }
+        }
+    }
+}
+
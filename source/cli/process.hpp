@@ -0,0 +1,62 @@
+#pragma once
+#include "options.hpp"
+#include "../token-tree/token-tree.hpp"
+#include "../token-tree/error.hpp"
+#include "../token-tree/cache.hpp"
+#include "../introspection/tape.hpp"
+#include <string>
+#include <iostream>
+
+namespace cctt
+{
+    namespace cli
+    {
+        // The steps of processing one source, as done by the command line and the server.
+        // Regular outputs go to out, and errors to err.
+
+        auto report_parsing_error(std::ostream& err, std::string const& path, char const* what) -> void;
+
+        // Report the errors recovered from while building a tree of path.
+        auto report_diagnostics(std::ostream& err, std::string const& path, Token_Tree_Diagnostics const& diagnostics) -> void;
+
+        // Build tt from source as opts say, through cache if it is not nullptr and opts need no include directives.
+        // Errors are reported to err.
+        // Returns false if there is no tree to go on with.
+        auto build_token_tree(
+            Options const& opts,
+            std::string const& path,
+            std::string const& source,
+            Token_Tree& tt,
+            Token_Tree_Diagnostics& diagnostics,
+            Token_Tree_Cache* cache,
+            std::ostream& err
+        ) -> bool;
+
+        // Print the changes from old_tt to tt, with their source locations.
+        auto write_diff(
+            std::string const& old_path,
+            Token_Tree const& old_tt,
+            std::string const& path,
+            Token_Tree const& tt,
+            std::ostream& out
+        ) -> void;
+
+        // Print a line naming path before its outputs, where the outputs of several files share out.
+        // Only the text formats need it: JSON and binary exports name the path in their own records.
+        auto write_path_header(Options const& opts, std::string const& path, std::ostream& out) -> void;
+
+        // Print tt and its introspection results, as opts say.
+        // If tape is given, introspection events are replayed from it, or recorded into it if it is empty.
+        // Parsing errors are reported to err.
+        // Throws std::runtime_error if the region asked by opts does not exist.
+        auto write_outputs(
+            Options const& opts,
+            std::string const& path,
+            Token_Tree const& tt,
+            std::ostream& out,
+            std::ostream& err,
+            Introspection_Tape* tape=nullptr
+        ) -> void;
+    }
+}
+
@@ -0,0 +1,399 @@
+#include "server.hpp"
+#include "options.hpp"
+#include "process.hpp"
+#include "../util/file.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "../util/style.inl"
+
+namespace cctt
+{
+    namespace cli
+    {
+        namespace
+        {
+            // The protocol, in host byte order:
+            //
+            //   request:   u32 count, then count strings: the current directory of the client, then the arguments.
+            //   response:  two strings: the output, then the errors.
+            //
+            //   string:    u64 length, then the bytes.
+
+            auto send_all(int fd, void const* data, std::size_t size) -> bool
+            {
+                auto p = static_cast<char const*>(data);
+                while (size != 0) {
+                    auto n = ::send(fd, p, size, MSG_NOSIGNAL);
+                    if (n < 0 && errno == EINTR) continue;
+                    if (n <= 0) return false;
+                    p += n;
+                    size -= std::size_t(n);
+                }
+                return true;
+            }
+
+            auto recv_all(int fd, void* data, std::size_t size) -> bool
+            {
+                auto p = static_cast<char*>(data);
+                while (size != 0) {
+                    auto n = ::recv(fd, p, size, 0);
+                    if (n < 0 && errno == EINTR) continue;
+                    if (n <= 0) return false;
+                    p += n;
+                    size -= std::size_t(n);
+                }
+                return true;
+            }
+
+            auto send_string(int fd, std::string const& x) -> bool
+            {
+                auto size = std::uint64_t(x.size());
+                return (send_all(fd, &size, sizeof(size)) && send_all(fd, x.data(), x.size()));
+            }
+
+            // Strings longer than max_size are rejected, against broken peers.
+            auto recv_string(int fd, std::string& x, std::uint64_t max_size) -> bool
+            {
+                std::uint64_t size;
+                if (!recv_all(fd, &size, sizeof(size)) || size > max_size) return false;
+                x.resize(std::size_t(size));
+                return recv_all(fd, &x[0], x.size());
+            }
+
+            auto socket_address_of(char const* path) -> sockaddr_un
+            {
+                sockaddr_un addr{};
+                addr.sun_family = AF_UNIX;
+                if (std::strlen(path) >= sizeof(addr.sun_path))
+                    throw std::runtime_error{"Socket path is too long: " + std::string{path}};
+                std::strcpy(addr.sun_path, path);
+                return addr;
+            }
+
+            // Closes on destruction.
+            struct Socket final
+            {
+                Socket(int fd): fd{fd} {}
+                ~Socket() { if (fd >= 0) ::close(fd); }
+
+                Socket(Socket const&) = delete;
+                auto operator = (Socket const&) -> Socket& = delete;
+
+                int fd;
+            };
+
+            struct Cached_Tree final
+            {
+                struct timespec mtime;
+                off_t size;
+                std::string source;
+                Token_Tree tt;
+            };
+
+            // Least recently used trees are evicted first.
+            // Trees are shared with the requests using them, so eviction never invalidates them.
+            struct Tree_LRU final
+            {
+                Tree_LRU(std::size_t max_size): max_size{max_size} {}
+
+                auto find(std::string const& path, struct stat const& st) -> std::shared_ptr<Cached_Tree const>
+                {
+                    std::lock_guard<std::mutex> lock{mutex};
+
+                    auto it = index.find(path);
+                    if (it == index.end()) return nullptr;
+
+                    auto& tree = it->second->second;
+                    if (tree->size != st.st_size
+                        || tree->mtime.tv_sec != st.st_mtim.tv_sec
+                        || tree->mtime.tv_nsec != st.st_mtim.tv_nsec) {
+                        order.erase(it->second);
+                        index.erase(it);
+                        return nullptr;
+                    }
+
+                    order.splice(order.begin(), order, it->second);
+                    return tree;
+                }
+
+                auto insert(std::string const& path, std::shared_ptr<Cached_Tree const> tree) -> void
+                {
+                    std::lock_guard<std::mutex> lock{mutex};
+
+                    auto it = index.find(path);
+                    if (it != index.end()) {
+                        order.erase(it->second);
+                        index.erase(it);
+                    }
+
+                    order.emplace_front(path, std::move(tree));
+                    index.emplace(path, order.begin());
+
+                    while (order.size() > max_size) {
+                        index.erase(order.back().first);
+                        order.pop_back();
+                    }
+                }
+
+            private:
+                using Order = std::list<std::pair<std::string, std::shared_ptr<Cached_Tree const>>>;
+
+                std::size_t max_size;
+                std::mutex mutex;
+                Order order;    // most recently used first
+                std::unordered_map<std::string, Order::iterator> index;
+            };
+
+            // Accepted connections waiting for a worker.
+            struct Connection_Queue final
+            {
+                auto push(int fd) -> void
+                {
+                    {
+                        std::lock_guard<std::mutex> lock{mutex};
+                        fds.push_back(fd);
+                    }
+                    ready.notify_one();
+                }
+
+                // Returns -1 once the queue is closed.
+                auto pop() -> int
+                {
+                    std::unique_lock<std::mutex> lock{mutex};
+                    ready.wait(lock, [this] { return (!fds.empty() || closed); });
+                    if (fds.empty()) return -1;
+
+                    auto fd = fds.front();
+                    fds.pop_front();
+                    return fd;
+                }
+
+                // Connections not taken yet are closed.
+                auto close() -> void
+                {
+                    {
+                        std::lock_guard<std::mutex> lock{mutex};
+                        closed = true;
+                        for (auto fd: fds) ::close(fd);
+                        fds.clear();
+                    }
+                    ready.notify_all();
+                }
+
+            private:
+                std::mutex mutex;
+                std::condition_variable ready;
+                std::deque<int> fds;
+                bool closed{};
+            };
+
+            // Failures of accept() that concern only one connection, or last only until others are closed.
+            auto is_transient_accept_error(int error) -> bool
+            {
+                switch (error) {
+                    case EINTR: case ECONNABORTED: case EPROTO: case EPERM:
+                    case EMFILE: case ENFILE: case ENOBUFS: case ENOMEM:
+                        return true;
+                    default:
+                        return false;
+                }
+            }
+
+            // The first option that requests cannot have, if any.
+            // Includes are not resolved, as they are relative to the client.
+            auto unserved_option_of(Options const& opts) -> char const*
+            {
+                if (opts.includes) return "--format=includes";
+                if (opts.follow_includes) return "--follow-includes";
+                if (!opts.include_dirs.empty()) return "-I";
+                if (!opts.cache_dir.empty()) return "--cache-dir";
+                if (!opts.publish.empty()) return "--publish";
+                if (!opts.diff_from.empty()) return "--diff";
+                if (opts.watch) return "--watch";
+                if (!opts.serve.empty()) return "--serve";
+                return nullptr;
+            }
+
+            auto handle_paths(Options const& opts, std::string const& cwd, Tree_LRU& trees, std::ostream& out, std::ostream& err) -> void
+            {
+                Token_Tree_Diagnostics diagnostics;
+
+                for (auto& path: opts.paths) {
+                    auto full_path = (path[0] == '/' ? path : cwd + "/" + path);
+
+                    struct stat st;
+                    if (::stat(full_path.data(), &st) != 0)
+                        throw std::runtime_error{"Cannot load file: " + path};
+
+                    // Trees built with recovery are not shared, as they depend on the request.
+                    auto tree = (opts.recover ? nullptr : trees.find(full_path, st));
+
+                    if (tree == nullptr) {
+                        auto fresh = std::make_shared<Cached_Tree>();
+                        fresh->mtime = st.st_mtim;
+                        fresh->size = st.st_size;
+                        util::slurp(full_path.data(), fresh->source);
+
+                        if (!build_token_tree(opts, path, fresh->source, fresh->tt, diagnostics, nullptr, err))
+                            continue;
+
+                        if (!opts.recover) trees.insert(full_path, fresh);
+                        tree = std::move(fresh);
+                    }
+
+                    write_outputs(opts, path, tree->tt, out, err);
+                }
+            }
+
+            auto handle(int fd, Tree_LRU& trees) -> void
+            {
+                Socket client{fd};
+                constexpr auto max_argument_size = std::uint64_t(1) << 20;
+                constexpr auto max_argument_count = std::uint32_t(1) << 16;
+
+                std::uint32_t count;
+                if (!recv_all(fd, &count, sizeof(count)) || count == 0 || count > max_argument_count) return;
+
+                std::vector<std::string> args(count);
+                for (auto& arg: args)
+                    if (!recv_string(fd, arg, max_argument_size))
+                        return;
+
+                // args[0] is the current directory of the client, in place of the program name.
+                std::vector<char*> argv;
+                for (auto& arg: args) argv.push_back(&arg[0]);
+
+                std::ostringstream out;
+                std::ostringstream err;
+
+                try {
+                    auto opts = parse_options(int(argv.size()), argv.data());
+                    if (opts.paths.empty()) throw std::runtime_error{"The server requires paths to process."};
+                    if (auto option = unserved_option_of(opts)) throw std::runtime_error{"The server does not serve " + std::string{option} + "."};
+                    handle_paths(opts, args[0], trees, out, err);
+                }
+                // One bad request must not take the server down.
+                catch (std::exception const& e) {
+                    err << STYLE_ERROR << e.what() << STYLE_NORMAL << "\n";
+                }
+                catch (...) {
+                    err << STYLE_ERROR "Cannot handle the request." STYLE_NORMAL "\n";
+                }
+
+                send_string(fd, out.str()) && send_string(fd, err.str());
+            }
+        }
+
+        auto run_server(char const* socket_path, unsigned workers, std::size_t max_trees) -> void
+        {
+            auto addr = socket_address_of(socket_path);
+
+            Socket server{::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+            if (server.fd < 0) throw std::runtime_error{"Cannot create socket: " + std::string{std::strerror(errno)}};
+
+            // Replace the socket left by a previous server, but nothing else.
+            struct stat st;
+            if (::lstat(socket_path, &st) == 0) {
+                if (!S_ISSOCK(st.st_mode)) throw std::runtime_error{"Cannot listen on " + std::string{socket_path} + ": file exists"};
+                ::unlink(socket_path);
+            }
+            if (::bind(server.fd, reinterpret_cast<sockaddr const*>(&addr), sizeof(addr)) != 0 || ::listen(server.fd, 64) != 0)
+                throw std::runtime_error{"Cannot listen on " + std::string{socket_path} + ": " + std::strerror(errno)};
+
+            if (workers == 0) workers = std::max(1u, std::thread::hardware_concurrency());
+
+            Tree_LRU trees{max_trees};
+            Connection_Queue queue;
+
+            std::vector<std::thread> threads;
+            threads.reserve(workers);
+
+            // Workers finish their requests before anything is thrown.
+            try {
+                for (unsigned i=0; i < workers; i++) {
+                    threads.emplace_back([&] {
+                        for (int fd; (fd = queue.pop()) >= 0; ) {
+                            // Failures to receive a request (e.g. bad_alloc) drop its connection only.
+                            try {
+                                handle(fd, trees);
+                            }
+                            catch (...) {
+                            }
+                        }
+                    });
+                }
+
+                while (true) {
+                    auto fd = ::accept4(server.fd, nullptr, nullptr, SOCK_CLOEXEC);
+                    if (fd >= 0) {
+                        queue.push(fd);
+                        continue;
+                    }
+
+                    auto error = errno;
+                    if (!is_transient_accept_error(error))
+                        throw std::runtime_error{"Cannot accept: " + std::string{std::strerror(error)}};
+
+                    // Out of descriptors or memory: wait for requests to finish.
+                    if (error != EINTR && error != ECONNABORTED)
+                        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+                }
+            }
+            catch (...) {
+                queue.close();
+                for (auto& thread: threads)
+                    thread.join();
+                throw;
+            }
+        }
+
+        auto run_client(char const* socket_path, std::vector<std::string> const& args) -> void
+        {
+            auto addr = socket_address_of(socket_path);
+
+            Socket server{::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+            if (server.fd < 0 || ::connect(server.fd, reinterpret_cast<sockaddr const*>(&addr), sizeof(addr)) != 0)
+                throw std::runtime_error{"Cannot connect to " + std::string{socket_path} + ": " + std::strerror(errno)};
+
+            std::string cwd(4096, '\0');
+            while (::getcwd(&cwd[0], cwd.size()) == nullptr) {
+                if (errno != ERANGE) throw std::runtime_error{"Cannot get current directory: " + std::string{std::strerror(errno)}};
+                cwd.resize(cwd.size() * 2);
+            }
+            cwd.resize(std::strlen(cwd.data()));
+
+            auto count = std::uint32_t(args.size() + 1);
+            auto ok = send_all(server.fd, &count, sizeof(count)) && send_string(server.fd, cwd);
+            for (auto& arg: args) ok = ok && send_string(server.fd, arg);
+
+            std::string out;
+            std::string err;
+            constexpr auto max_output_size = ~std::uint64_t{};
+            ok = ok && recv_string(server.fd, out, max_output_size) && recv_string(server.fd, err, max_output_size);
+            if (!ok) throw std::runtime_error{"Connection to the server is broken."};
+
+            std::cout.write(out.data(), std::streamsize(out.size()));
+            std::cout.flush();
+            std::clog.write(err.data(), std::streamsize(err.size()));
+            std::clog.flush();
+        }
+    }
+}
+
@@ -0,0 +1,28 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstddef>
+
+namespace cctt
+{
+    namespace cli
+    {
+        // Serve clients on a Unix domain socket at socket_path, until the process is killed.
+        //
+        // Each request is a command line (see parse_options()), which is handled by one of workers threads
+        // (0 means as many as there are hardware threads) with the same outputs as the command line.
+        // Token trees are kept in memory, at most max_trees of them, keyed by path,
+        // and rebuilt when the modification time or size of the file changes.
+        //
+        // Throws std::runtime_error if the socket cannot be set up.
+        auto run_server(char const* socket_path, unsigned workers, std::size_t max_trees=256) -> void;
+
+        // Send args (a command line without the program name) to the server at socket_path,
+        // and write the outputs of the request to std::cout and std::clog.
+        // Relative paths are resolved against the current directory of the client.
+        //
+        // Throws std::runtime_error if the server cannot be reached.
+        auto run_client(char const* socket_path, std::vector<std::string> const& args) -> void;
+    }
+}
+
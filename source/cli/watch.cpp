@@ -0,0 +1,298 @@
+#include "watch.hpp"
+#include "process.hpp"
+#include "../util/file.hpp"
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../util/style.inl"
+
+namespace cctt
+{
+    namespace cli
+    {
+        namespace
+        {
+            // Events closer than this are taken as one burst.
+            constexpr auto burst_interval_ms = 50;
+
+            auto is_cpp_file(std::string const& name) -> bool
+            {
+                static char const* const extensions[] = {
+                    ".h", ".hh", ".hpp", ".hxx", ".inl",
+                    ".c", ".cc", ".cpp", ".cxx",
+                };
+
+                auto dot = name.rfind('.');
+                if (dot == std::string::npos) return false;
+
+                auto extension = name.substr(dot);
+                return std::any_of(std::begin(extensions), std::end(extensions), [&] (char const* x) { return extension == x; });
+            }
+
+            auto is_directory(std::string const& path) -> bool
+            {
+                struct stat st;
+                return (::stat(path.data(), &st) == 0 && S_ISDIR(st.st_mode));
+            }
+
+            auto directory_of(std::string const& path) -> std::string
+            {
+                auto slash = path.rfind('/');
+                if (slash == std::string::npos) return ".";
+                if (slash == 0) return "/";
+                return path.substr(0, slash);
+            }
+
+            auto base_name_of(std::string const& path) -> std::string
+            {
+                return path.substr(path.rfind('/') + 1);
+            }
+
+            auto join(std::string const& directory, char const* name) -> std::string
+            {
+                if (directory == ".") return name;
+                if (directory.back() == '/') return directory + name;
+                return directory + "/" + name;
+            }
+
+            struct Watched_File final
+            {
+                std::string source;
+                Token_Tree tt;
+
+                // Whether tt is built from source; otherwise, it is built again from scratch.
+                bool built{};
+            };
+
+            struct Watcher final
+            {
+                Watcher(Options const& opts, Token_Tree_Cache* cache)
+                    : opts{opts}
+                    , cache{cache}
+                    , fd{::inotify_init1(IN_CLOEXEC)}
+                {
+                    if (fd < 0) throw std::runtime_error{"Cannot watch files: " + std::string{std::strerror(errno)}};
+                }
+
+                ~Watcher() { ::close(fd); }
+
+                Watcher(Watcher const&) = delete;
+                auto operator = (Watcher const&) -> Watcher& = delete;
+
+                auto add_path(std::string const& path) -> void
+                {
+                    if (is_directory(path)) {
+                        add_directory(path);
+                    } else {
+                        auto wd = watch(directory_of(path), false);
+                        explicit_files[{wd, base_name_of(path)}] = path;
+
+                        // It is processed once it is created.
+                        if (::access(path.data(), F_OK) != 0) {
+                            std::clog << STYLE_ERROR "Cannot load file: " << path << STYLE_NORMAL "\n";
+                            std::clog.flush();
+                        }
+
+                        update(path);
+                    }
+                }
+
+                auto run() -> void
+                {
+                    std::set<std::string> changed;
+
+                    while (true) {
+                        auto timeout = (changed.empty() ? -1 : burst_interval_ms);
+
+                        pollfd pfd{fd, POLLIN, 0};
+                        auto n = ::poll(&pfd, 1, timeout);
+                        if (n < 0 && errno == EINTR) continue;
+                        if (n < 0) throw std::runtime_error{"Cannot watch files: " + std::string{std::strerror(errno)}};
+
+                        if (n == 0) {
+                            for (auto& path: changed) update(path);
+                            changed.clear();
+                            continue;
+                        }
+
+                        read_events(changed);
+                    }
+                }
+
+            private:
+                Options const& opts;
+                Token_Tree_Cache* cache;
+                int fd;
+
+                // Watched directories by watch descriptor, and whether all their C++ files are watched.
+                struct Directory final
+                {
+                    std::string path;
+                    bool whole;
+                };
+                std::unordered_map<int, Directory> directories;
+
+                // Given by paths, rather than found in directories, as given, by watch descriptor and name.
+                // The directory may be watched under another spelling of its path.
+                std::map<std::pair<int, std::string>, std::string> explicit_files;
+
+                // In a std::map, so that sources do not move under their trees.
+                std::map<std::string, Watched_File> files;
+
+                Token_Tree_Diagnostics diagnostics;
+
+                // Returns the watch descriptor.
+                auto watch(std::string const& directory, bool whole) -> int
+                {
+                    constexpr auto mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_CREATE | IN_ONLYDIR;
+
+                    auto wd = ::inotify_add_watch(fd, directory.data(), mask);
+                    if (wd < 0) throw std::runtime_error{"Cannot watch " + directory + ": " + std::strerror(errno)};
+
+                    auto& dir = directories[wd];
+                    if (dir.path.empty()) dir.path = directory;
+                    dir.whole = (dir.whole || whole);
+                    return wd;
+                }
+
+                auto add_directory(std::string const& directory) -> void
+                {
+                    watch(directory, true);
+
+                    std::vector<std::string> names;
+                    if (auto dir = ::opendir(directory.data())) {
+                        while (auto entry = ::readdir(dir))
+                            if (std::strcmp(entry->d_name, ".") != 0 && std::strcmp(entry->d_name, "..") != 0)
+                                names.emplace_back(entry->d_name);
+                        ::closedir(dir);
+                    }
+                    std::sort(names.begin(), names.end());
+
+                    for (auto& name: names) {
+                        auto path = join(directory, name.data());
+                        if (is_directory(path)) add_directory(path);
+                        else if (is_cpp_file(name)) update(path);
+                    }
+                }
+
+                auto read_events(std::set<std::string>& changed) -> void
+                {
+                    alignas(inotify_event) char buffer[64 * 1024];
+
+                    auto size = ::read(fd, buffer, sizeof(buffer));
+                    if (size < 0 && (errno == EINTR || errno == EAGAIN)) return;
+                    if (size < 0) throw std::runtime_error{"Cannot watch files: " + std::string{std::strerror(errno)}};
+
+                    for (auto p=buffer; p < buffer + size; ) {
+                        auto& event = *reinterpret_cast<inotify_event const*>(p);
+                        p += sizeof(inotify_event) + event.len;
+
+                        if (event.mask & IN_IGNORED) {
+                            directories.erase(event.wd);
+                            continue;
+                        }
+
+                        auto it = directories.find(event.wd);
+                        if (it == directories.end() || event.len == 0) continue;
+
+                        auto dir = it->second;
+                        auto path = join(dir.path, event.name);
+
+                        if (event.mask & IN_ISDIR) {
+                            if (dir.whole && (event.mask & (IN_CREATE | IN_MOVED_TO))) add_directory(path);
+                            continue;
+                        }
+
+                        if (event.mask & IN_CREATE) continue;   // wait for its content
+
+                        auto explicit_file = explicit_files.find({event.wd, event.name});
+                        if (explicit_file != explicit_files.end()) changed.insert(explicit_file->second);
+                        else if (dir.whole && is_cpp_file(event.name)) changed.insert(path);
+                    }
+                }
+
+                // Process the file at path if its content changed, or forget it if it is gone.
+                auto update(std::string const& path) -> void
+                {
+                    struct stat st;
+                    if (::stat(path.data(), &st) != 0 || !S_ISREG(st.st_mode)) {
+                        files.erase(path);
+                        return;
+                    }
+
+                    try {
+                        util::slurp(path.data(), scratch);
+                    }
+                    catch (std::runtime_error const& e) {
+                        std::clog << STYLE_ERROR << e.what() << STYLE_NORMAL << "\n";
+                        std::clog.flush();
+                        return;
+                    }
+
+                    auto& file = files[path];
+                    if (file.built && file.source == scratch) return;
+
+                    if (!file.built || opts.recover) {
+                        file.source.swap(scratch);
+                        file.built = build_token_tree(opts, path, file.source, file.tt, diagnostics, cache, std::clog);
+                    } else {
+                        // The edit is what lies between the common prefix and the common suffix.
+                        auto old_size = file.source.size();
+                        auto new_size = scratch.size();
+
+                        auto prefix = std::size_t(std::mismatch(
+                            file.source.begin(), file.source.begin() + std::ptrdiff_t(std::min(old_size, new_size)),
+                            scratch.begin()
+                        ).first - file.source.begin());
+
+                        auto suffix = std::size_t(std::mismatch(
+                            file.source.rbegin(), file.source.rbegin() + std::ptrdiff_t(std::min(old_size, new_size) - prefix),
+                            scratch.rbegin()
+                        ).first - file.source.rbegin());
+
+                        file.source.swap(scratch);
+
+                        Token_Tree_Error error;
+                        file.built = file.tt.try_apply_edit(file.source.data(), prefix, old_size - prefix - suffix, new_size - prefix - suffix, error);
+                        if (!file.built) report_parsing_error(std::clog, path, error.message().data());
+                    }
+
+                    if (!file.built) return;
+
+                    try {
+                        write_path_header(opts, path, std::cout);
+                        write_outputs(opts, path, file.tt, std::cout, std::clog);
+                    }
+                    catch (std::runtime_error const& e) {
+                        std::clog << STYLE_ERROR << e.what() << STYLE_NORMAL << "\n";
+                        std::clog.flush();
+                    }
+                }
+
+                // Reused for reading files.
+                std::string scratch;
+            };
+        }
+
+        auto run_watch(Options const& opts, Token_Tree_Cache* cache) -> void
+        {
+            Watcher watcher{opts, cache};
+            for (auto& path: opts.paths) watcher.add_path(path);
+            watcher.run();
+        }
+    }
+}
+
@@ -0,0 +1,21 @@
+#pragma once
+#include "options.hpp"
+#include "../token-tree/cache.hpp"
+
+namespace cctt
+{
+    namespace cli
+    {
+        // Process opts.paths once, then again whenever they change, until the process is killed.
+        //
+        // Paths are files, or directories, whose C++ files (by extension) are watched, including those in subdirectories
+        // and those created later. Changes are watched through inotify, and coalesced over bursts of events.
+        // Only files whose content changed are processed again, by applying the edit to their token trees,
+        // and only their outputs are written.
+        //
+        // The cache, if not nullptr, is used for the first processing of each file.
+        // Throws std::runtime_error if watching cannot be set up.
+        auto run_watch(Options const& opts, Token_Tree_Cache* cache) -> void;
+    }
+}
+
@@ -1,9 +1,28 @@
 #include "dump.hpp"
-#include <iostream>
 
 namespace cctt
 {
-    Introspection_Dumper::Introspection_Dumper()
+    namespace
+    {
+        template <std::size_t len>
+        auto write(fmt::memory_buffer& out, char const (&text)[len]) -> void
+        {
+            out.append(text, text + len - 1);
+        }
+
+        auto write(fmt::memory_buffer& out, char const* first, char const* last) -> void
+        {
+            out.append(first, last);
+        }
+
+        auto write(fmt::memory_buffer& out, fmt::memory_buffer const& text) -> void
+        {
+            out.append(text.data(), text.data() + text.size());
+        }
+    }
+
+    Introspection_Dumper::Introspection_Dumper(std::ostream& sink)
+        : sink{sink}
     {
         constexpr auto estimated_full_namespace_size = 1024;
         full_namespace.reserve(estimated_full_namespace_size);
@@ -11,121 +30,126 @@ namespace cctt
 
     auto Introspection_Dumper::empty() -> void
     {
-        std::cout << "Nothing interesting.\n";
-        std::cout.flush();
+        write(out, "Nothing interesting.\n");
+        flush();
     }
 
     auto Introspection_Dumper::start() -> void
     {
-        std::cout << "Start processing.\n";
-        std::cout.flush();
+        write(out, "Start processing.\n");
     }
 
     auto Introspection_Dumper::finish() -> void
     {
-        std::cout << "All processed.\n";
-        std::cout.flush();
+        write(out, "All processed.\n");
+        flush();
     }
 
     auto Introspection_Dumper::abort() -> void
     {
-        std::cout << "Aborted.\n";
-        std::cout.flush();
+        write(out, "Aborted.\n");
+        flush();
     }
 
     auto Introspection_Dumper::add_attributes(Token const* attribs) -> void
     {
-        std::cout << "  attributes: ";
-        std::cout.write(attribs->first, attribs->pair->last - attribs->first);
-        std::cout << "\n";
-        std::cout.flush();
+        write(out, "  attributes: ");
+        write(out, attribs->first, attribs->pair->last);
+        write(out, "\n");
     }
 
     auto Introspection_Dumper::clear_attributes() -> void
     {
-        std::cout << "  attributes: clear\n";
-        std::cout.flush();
+        write(out, "  attributes: clear\n");
     }
 
     auto Introspection_Dumper::enter_namespace(Token const* name_first, Token const* name_last) -> void
     {
-        full_namespace += "::";
-        full_namespace.append(name_first->first, name_last[-1].last);
+        write(full_namespace, "::");
+        write(full_namespace, name_first->first, name_last[-1].last);
 
-        std::cout << "  namespace " << full_namespace << " {\n";
-        std::cout.flush();
+        write(out, "  namespace ");
+        write(out, full_namespace);
+        write(out, " {\n");
     }
 
     auto Introspection_Dumper::leave_namespace() -> void
     {
-        std::cout << "  } // namespace " << full_namespace << " -> ";
+        write(out, "  } // namespace ");
+        write(out, full_namespace);
+        write(out, " -> ");
 
-        full_namespace.erase(full_namespace.rfind("::"));
+        // Pop the last "::" segment. Note that `namespace a::b` pushes
+        // "::a::b" but only pops "::b".
+        auto size = full_namespace.size();
+        while (size >= 2 && !(full_namespace[size-2] == ':' && full_namespace[size-1] == ':'))
+            size--;
+        full_namespace.resize(size >= 2 ? size - 2 : 0);
 
-        std::cout << (full_namespace.empty() ? "::" : full_namespace.data()) << "\n";
-        std::cout.flush();
+        if (full_namespace.size() == 0) write(out, "::");
+        else write(out, full_namespace);
+        write(out, "\n");
     }
 
     auto Introspection_Dumper::enter_enum(Token const* name) -> void
     {
-        auto full_name = full_namespace;
-        full_name += "::";
-        full_name.append(name->first, name->last);
-
-        std::cout << "  enum " << full_name << " {\n";
-        std::cout.flush();
+        write(out, "  enum ");
+        write_full_name(name);
+        write(out, " {\n");
     }
 
     auto Introspection_Dumper::leave_enum() -> void
     {
-        std::cout << "  } // enum\n";
-        std::cout.flush();
+        write(out, "  } // enum\n");
     }
 
     auto Introspection_Dumper::enumerator(Token const* name) -> void
     {
-        std::cout << "      enumerator ";
-        std::cout.write(name->first, name->last - name->first);
-        std::cout << "\n";
-        std::cout.flush();
+        write(out, "      enumerator ");
+        write(out, name->first, name->last);
+        write(out, "\n");
     }
 
     auto Introspection_Dumper::integral_constant(Token const* name) -> void
     {
-        auto full_name = full_namespace;
-        full_name += "::";
-        full_name.append(name->first, name->last);
-
-        std::cout << "  int constant " << full_name << "\n";
-        std::cout.flush();
+        write(out, "  int constant ");
+        write_full_name(name);
+        write(out, "\n");
     }
 
     auto Introspection_Dumper::structure(Token const* name) -> void
     {
-        auto full_name = full_namespace;
-        full_name += "::";
-        full_name.append(name->first, name->last);
-
-        std::cout << "  struct " << full_name << "\n";
-        std::cout.flush();
+        write(out, "  struct ");
+        write_full_name(name);
+        write(out, "\n");
     }
 
     auto Introspection_Dumper::parent(Token const* first, Token const* last) -> void
     {
-        std::cout << "      : ";
-        std::cout.write(first->first, last->first - first->first);
-        std::cout << "\n";
-        std::cout.flush();
+        write(out, "      : ");
+        write(out, first->first, last->first);
+        write(out, "\n");
     }
 
     auto Introspection_Dumper::variable_or_function(Token const* name) -> void
     {
-        auto full_name = full_namespace;
-        full_name += "::";
-        full_name.append(name->first, name->last);
+        write(out, "  var or fn ");
+        write_full_name(name);
+        write(out, "\n");
+    }
+
+    auto Introspection_Dumper::write_full_name(Token const* name) -> void
+    {
+        write(out, full_namespace);
+        write(out, "::");
+        write(out, name->first, name->last);
+    }
 
-        std::cout << "  var or fn " << full_name << "\n";
-        std::cout.flush();
+    auto Introspection_Dumper::flush() -> void
+    {
+        sink.write(out.data(), out.size());
+        sink.flush();
+        out.resize(0);
     }
 }
 
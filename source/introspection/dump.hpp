@@ -1,12 +1,15 @@
 #pragma once
 #include "handler.hpp"
-#include <string>
+#include <fmt/format.hpp>
+#include <iostream>
 
 namespace cctt
 {
+    // Output is accumulated in memory and written to the sink in one go,
+    // when empty(), finish() or abort() is called.
     struct Introspection_Dumper final: Introspection_Handler
     {
-        Introspection_Dumper();
+        Introspection_Dumper(std::ostream& sink=std::cout);
 
         auto empty() -> void override;
 
@@ -33,7 +36,12 @@ namespace cctt
         auto variable_or_function(Token const* name) -> void override;
 
     private:
-        std::string full_namespace;
+        std::ostream& sink;
+        fmt::memory_buffer out;
+        fmt::memory_buffer full_namespace;
+
+        auto write_full_name(Token const* name) -> void;
+        auto flush() -> void;
     };
 }
 
@@ -0,0 +1,205 @@
+#include "export.hpp"
+#include "../util/string.hpp"
+#include <utility>
+
+namespace cctt
+{
+    namespace
+    {
+        auto event_name_of(Export_Event event) -> char const*
+        {
+            switch (event) {
+                case Export_Event::empty: return "empty";
+                case Export_Event::start: return "start";
+                case Export_Event::finish: return "finish";
+                case Export_Event::abort: return "abort";
+                case Export_Event::add_attributes: return "add_attributes";
+                case Export_Event::clear_attributes: return "clear_attributes";
+                case Export_Event::enter_namespace: return "enter_namespace";
+                case Export_Event::leave_namespace: return "leave_namespace";
+                case Export_Event::enter_enum: return "enter_enum";
+                case Export_Event::leave_enum: return "leave_enum";
+                case Export_Event::enumerator: return "enumerator";
+                case Export_Event::integral_constant: return "integral_constant";
+                case Export_Event::structure: return "structure";
+                case Export_Event::parent: return "parent";
+                case Export_Event::variable_or_function: return "variable_or_function";
+                case Export_Event::file: return "file";
+            }
+            return "";
+        }
+
+        auto write_u32(fmt::memory_buffer& out, std::uint32_t x) -> void
+        {
+            char bytes[] = {
+                char(x >>  0),
+                char(x >>  8),
+                char(x >> 16),
+                char(x >> 24),
+            };
+            out.append(bytes, bytes + sizeof(bytes));
+        }
+    }
+
+    Introspection_Exporter::Introspection_Exporter(Token_Tree const& tt, Export_Format format, std::ostream& sink)
+        : Introspection_Exporter{tt, "", format, sink}
+    {}
+
+    Introspection_Exporter::Introspection_Exporter(Token_Tree const& tt, std::string path, Export_Format format, std::ostream& sink)
+        : tt{tt}
+        , path{std::move(path)}
+        , format{format}
+        , sink{sink}
+    {}
+
+    auto Introspection_Exporter::empty() -> void
+    {
+        write_file();
+        write(Export_Event::empty);
+        flush();
+    }
+
+    auto Introspection_Exporter::start() -> void
+    {
+        write_file();
+        write(Export_Event::start);
+    }
+
+    auto Introspection_Exporter::finish() -> void
+    {
+        write(Export_Event::finish);
+        flush();
+    }
+
+    auto Introspection_Exporter::abort() -> void
+    {
+        write(Export_Event::abort);
+        flush();
+    }
+
+    auto Introspection_Exporter::add_attributes(Token const* attribs) -> void
+    {
+        write(Export_Event::add_attributes, "text", attribs->first, attribs->pair->last);
+    }
+
+    auto Introspection_Exporter::clear_attributes() -> void
+    {
+        write(Export_Event::clear_attributes);
+    }
+
+    auto Introspection_Exporter::enter_namespace(Token const* name_first, Token const* name_last) -> void
+    {
+        write(Export_Event::enter_namespace, "name", name_first->first, name_last[-1].last);
+    }
+
+    auto Introspection_Exporter::leave_namespace() -> void
+    {
+        write(Export_Event::leave_namespace);
+    }
+
+    auto Introspection_Exporter::enter_enum(Token const* name) -> void
+    {
+        write(Export_Event::enter_enum, "name", name->first, name->last);
+    }
+
+    auto Introspection_Exporter::leave_enum() -> void
+    {
+        write(Export_Event::leave_enum);
+    }
+
+    auto Introspection_Exporter::enumerator(Token const* name) -> void
+    {
+        write(Export_Event::enumerator, "name", name->first, name->last);
+    }
+
+    auto Introspection_Exporter::integral_constant(Token const* name) -> void
+    {
+        write(Export_Event::integral_constant, "name", name->first, name->last);
+    }
+
+    auto Introspection_Exporter::structure(Token const* name) -> void
+    {
+        write(Export_Event::structure, "name", name->first, name->last);
+    }
+
+    auto Introspection_Exporter::parent(Token const* first, Token const* last) -> void
+    {
+        // Trailing whitespaces are not part of the base clause.
+        auto text_last = (first < last ? last[-1].last : first->first);
+        write(Export_Event::parent, "text", first->first, text_last);
+    }
+
+    auto Introspection_Exporter::variable_or_function(Token const* name) -> void
+    {
+        write(Export_Event::variable_or_function, "name", name->first, name->last);
+    }
+
+    auto Introspection_Exporter::write(Export_Event event) -> void
+    {
+        switch (format) {
+            case Export_Format::json:
+                fmt::format_to(out, "{{\"event\":\"{}\"}}\n", event_name_of(event));
+                break;
+
+            case Export_Format::binary:
+                out.push_back(char(event));
+                write_u32(out, 0);
+                write_u32(out, 0);
+                write_u32(out, 0);
+                break;
+        }
+    }
+
+    auto Introspection_Exporter::write(Export_Event event, char const* key, char const* first, char const* last) -> void
+    {
+        auto loc = tt.source_location_of(first);
+
+        switch (format) {
+            case Export_Format::json:
+                fmt::format_to(out, "{{\"event\":\"{}\",\"{}\":\"", event_name_of(event), key);
+                util::append_json_escaped(out, first, last);
+                fmt::format_to(out, "\",\"line\":{},\"column\":{}}}\n", loc.line, loc.column);
+                break;
+
+            case Export_Format::binary:
+                out.push_back(char(event));
+                write_u32(out, std::uint32_t(loc.line));
+                write_u32(out, std::uint32_t(loc.column));
+                write_u32(out, std::uint32_t(last - first));
+                out.append(first, last);
+                break;
+        }
+    }
+
+    auto Introspection_Exporter::write_file() -> void
+    {
+        if (path.empty()) return;
+
+        auto first = path.data();
+        auto last = first + path.size();
+
+        switch (format) {
+            case Export_Format::json:
+                fmt::format_to(out, "{{\"event\":\"{}\",\"path\":\"", event_name_of(Export_Event::file));
+                util::append_json_escaped(out, first, last);
+                fmt::format_to(out, "\"}}\n");
+                break;
+
+            case Export_Format::binary:
+                out.push_back(char(Export_Event::file));
+                write_u32(out, 0);
+                write_u32(out, 0);
+                write_u32(out, std::uint32_t(last - first));
+                out.append(first, last);
+                break;
+        }
+    }
+
+    auto Introspection_Exporter::flush() -> void
+    {
+        sink.write(out.data(), out.size());
+        sink.flush();
+        out.resize(0);
+    }
+}
+
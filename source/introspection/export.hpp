@@ -0,0 +1,107 @@
+#pragma once
+#include "handler.hpp"
+#include "../token-tree/token-tree.hpp"
+#include <fmt/format.hpp>
+#include <iostream>
+#include <string>
+#include <cstdint>
+
+namespace cctt
+{
+    // Machine-readable alternatives to Introspection_Dumper.
+    //
+    // json:    One JSON object per line, e.g.
+    //
+    //            {"event":"structure","name":"Foo","line":12,"column":8}
+    //
+    //          "name" is present for events that carry a name;
+    //          "text" is present for add_attributes (the parenthesized tokens) and parent (the base clause);
+    //          "line" and "column" are present whenever one of the above is.
+    //
+    //          If a path is given, the events of each run start with
+    //
+    //            {"event":"file","path":"foo.hpp"}
+    //
+    //          so that the outputs of several files can share a stream.
+    //
+    // binary:  A sequence of records, all integers are little-endian:
+    //
+    //            u8  event         (see Export_Event)
+    //            u32 line          (0 if the event has no location)
+    //            u32 column        (0 if the event has no location)
+    //            u32 length
+    //            u8  text[length]  (name, text or path as in json, unescaped)
+    //
+    // Output is accumulated in memory and written to the sink in one go,
+    // when empty(), finish() or abort() is called.
+    enum struct Export_Format
+    {
+        json,
+        binary,
+    };
+
+    enum struct Export_Event: std::uint8_t
+    {
+        empty,
+        start,
+        finish,
+        abort,
+        add_attributes,
+        clear_attributes,
+        enter_namespace,
+        leave_namespace,
+        enter_enum,
+        leave_enum,
+        enumerator,
+        integral_constant,
+        structure,
+        parent,
+        variable_or_function,
+        file,
+    };
+
+    struct Introspection_Exporter final: Introspection_Handler
+    {
+        Introspection_Exporter(Token_Tree const& tt, Export_Format format, std::ostream& sink=std::cout);
+
+        // Same as above, with the path of the source of tt, for the file records.
+        Introspection_Exporter(Token_Tree const& tt, std::string path, Export_Format format, std::ostream& sink=std::cout);
+
+        auto empty() -> void override;
+
+        auto start() -> void override;
+        auto finish() -> void override;
+
+        auto abort() -> void override;
+
+        auto add_attributes(Token const* attribs) -> void override;
+        auto clear_attributes() -> void override;
+
+        auto enter_namespace(Token const* name_first, Token const* name_last) -> void override;
+        auto leave_namespace() -> void override;
+
+        auto enter_enum(Token const* name) -> void override;
+        auto leave_enum() -> void override;
+        auto enumerator(Token const* name) -> void override;
+
+        auto integral_constant(Token const* name) -> void override;
+
+        auto structure(Token const* name) -> void override;
+        auto parent(Token const* first, Token const* last) -> void override;
+
+        auto variable_or_function(Token const* name) -> void override;
+
+    private:
+        Token_Tree const& tt;
+        std::string path;
+        Export_Format format;
+        std::ostream& sink;
+        fmt::memory_buffer out;
+
+        auto write(Export_Event event) -> void;
+        auto write(Export_Event event, char const* key, char const* first, char const* last) -> void;
+        auto write_file() -> void;
+        auto flush() -> void;
+    };
+}
+
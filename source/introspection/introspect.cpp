@@ -1,5 +1,6 @@
 #include "../token-tree/error.hpp"
 #include "introspect.hpp"
+#include "multiplex.hpp"
 #include <vector>
 #include <cstddef>
 
@@ -321,7 +322,17 @@ namespace cctt
             }
         }
 
-        auto parse_struct_body(Introspection_Handler& ih, Token_Tree const& tt, Token const* & tk, bool publicity) -> void;
+        // Struct bodies are parsed iteratively, using an explicit stack of frames
+        // instead of recursion, so that deeply nested structs won't overflow the call stack.
+        //
+        // A frame is pushed when entering a struct body, and popped when its `}` is reached.
+        struct Frame
+        {
+            bool leave_namespace;   // call ih.leave_namespace() when the body ends.
+            bool clear_attributes;  // call ih.clear_attributes() when the body ends.
+        };
+
+        using Frames = std::vector<Frame>;
 
         // Skip items until these patterns:
         //
@@ -458,13 +469,28 @@ namespace cctt
             return false;
         }
 
+        // Enter a struct body:
+        //
+        //   { ....
+        //     ^
+        //     `-- tk must be here.
+        //
+        // The body itself will be parsed by parse_struct_body_item() later.
+        auto enter_struct_body(Token const* & tk, bool publicity, bool leave_namespace, Frames& frames) -> void
+        {
+            if (!publicity) skip_after_public(tk);
+            frames.push_back({leave_namespace, false});
+        }
+
         // Parse block level items, i.e. (member-)enums, (member-)integral constants,
         // (member-)variables, (member-)functions, and (member-)structs.
         // They may all optionally have a introspect attribute header each.
         //
         // On success, tk will be modified to the next unparsed token, and true will be returned;
         // On failure, tk will NOT be modified, and false will be returned;
-        auto parse_block_item(Introspection_Handler& ih, Token_Tree const& tt, Token const* & tk) -> bool
+        //
+        // For structs with a body, a frame is pushed and the body is left unparsed.
+        auto parse_block_item(Introspection_Handler& ih, Token_Tree const& tt, Token const* & tk, Frames& frames) -> bool
         {
             if (auto name = parse_enum_heading(tt, tk)) {
                 if (name == tk) {
@@ -481,15 +507,14 @@ namespace cctt
             auto bases = (Token const*) nullptr;
             if (auto name = parse_struct_heading(tt, tk, publicity, bases)) {
                 if (name == tk) {
-                    parse_struct_body(ih, tt, tk, publicity);
+                    enter_struct_body(tk, publicity, false, frames);
                 } else if (name+1 == tk) {
                     // Empty intentionally: ignore forward declarations
                 } else {
                     ih.structure(name);
                     if (bases != nullptr) parse_struct_bases(ih, bases, publicity);
                     ih.enter_namespace(name, name+1);
-                    parse_struct_body(ih, tt, tk, publicity);
-                    ih.leave_namespace();
+                    enter_struct_body(tk, publicity, true, frames);
                 }
                 return true;
             }
@@ -508,15 +533,18 @@ namespace cctt
         // On success, tk will be modified to the next unparsed token, and true will be returned;
         // If tk is NOT an introspect attribute, tk will NOT be modified, and false will be returned;
         // If tk IS an introspect attribute but failed to parse block items, an exception will be thrown.
-        auto parse_attributed_block_item(Introspection_Handler& ih, Token_Tree const& tt, Token const* & tk) -> bool
+        auto parse_attributed_block_item(Introspection_Handler& ih, Token_Tree const& tt, Token const* & tk, Frames& frames) -> bool
         {
             if (auto attribs = parse_introspect_attribute(tt, tk)) {
                 ih.add_attributes(attribs);
                 while (auto attribs = parse_introspect_attribute(tt, tk))
                     ih.add_attributes(attribs);
 
-                if (parse_block_item(ih, tt, tk)) {
-                    ih.clear_attributes();
+                auto depth = frames.size();
+                if (parse_block_item(ih, tt, tk, frames)) {
+                    // Attributes of a struct apply until the end of its body.
+                    if (frames.size() > depth) frames.back().clear_attributes = true;
+                    else ih.clear_attributes();
                     return true;
                 } else {
                     auto loc = tt.source_location_of(tk->first);
@@ -527,34 +555,38 @@ namespace cctt
             return false;
         }
 
-        auto parse_struct_body(Introspection_Handler& ih, Token_Tree const& tt, Token const* & tk, bool publicity) -> void
+        // Parse one item of the struct body on top of the frame stack.
+        // When the end of the body is reached, its frame is popped.
+        auto parse_struct_body_item(Introspection_Handler& ih, Token_Tree const& tt, Token const* & tk, Frames& frames) -> void
         {
-            if (!publicity) skip_after_public(tk);
+            if ((token_is(tk, "private", Token_Tag::identifier) || token_is(tk, "protected", Token_Tag::identifier)) && token_is(tk+1, ":", Token_Tag::symbol)) {
+                tk += 2;
+                skip_after_public(tk);
+            }
 
-            while (true) {
-                if ((token_is(tk, "private", Token_Tag::identifier) || token_is(tk, "protected", Token_Tag::identifier)) && token_is(tk+1, ":", Token_Tag::symbol)) {
-                    tk += 2;
-                    skip_after_public(tk);
-                }
+            if (token_is(tk, "using", Token_Tag::identifier) || token_is(tk, "typedef", Token_Tag::identifier)) {
+                while (!token_is(tk, ";", Token_Tag::symbol) && !token_is(tk, "}", Token_Tag::symbol))
+                    tk = tk->next();
+            }
 
-                if (token_is(tk, "using", Token_Tag::identifier) || token_is(tk, "typedef", Token_Tag::identifier)) {
-                    while (!token_is(tk, ";", Token_Tag::symbol) && !token_is(tk, "}", Token_Tag::symbol))
-                        tk = tk->next();
-                }
+            if (token_is(tk, "}", Token_Tag::symbol)) {
+                tk++;
 
-                if (token_is(tk, "}", Token_Tag::symbol))
-                    break;
+                auto frame = frames.back();
+                frames.pop_back();
 
-                if (parse_attributed_block_item(ih, tt, tk))
-                    continue;
+                if (frame.leave_namespace) ih.leave_namespace();
+                if (frame.clear_attributes) ih.clear_attributes();
+                return;
+            }
 
-                if (parse_block_item(ih, tt, tk))
-                    continue;
+            if (parse_attributed_block_item(ih, tt, tk, frames))
+                return;
 
-                tk = tk->next();
-            }
+            if (parse_block_item(ih, tt, tk, frames))
+                return;
 
-            tk++;
+            tk = tk->next();
         }
     }
 
@@ -565,10 +597,19 @@ namespace cctt
             return;
         }
 
+        constexpr auto estimated_struct_depth = 64;
+        Frames frames;
+        frames.reserve(estimated_struct_depth);
+
         try {
             ih.start();
 
-            for (auto tk=tt.begin(), last=tt.end(); tk < last;) {
+            for (auto tk=tt.begin(), last=tt.end(); tk < last || !frames.empty();) {
+                if (!frames.empty()) {
+                    parse_struct_body_item(ih, tt, tk, frames);
+                    continue;
+                }
+
                 if (token_is(tk, "}", Token_Tag::symbol)) {
                     ih.leave_namespace();
                     tk++;
@@ -580,7 +621,7 @@ namespace cctt
                     continue;
                 }
 
-                if (parse_attributed_block_item(ih, tt, tk)) {
+                if (parse_attributed_block_item(ih, tt, tk, frames)) {
                     continue;
                 }
 
@@ -594,5 +635,11 @@ namespace cctt
             throw;
         }
     }
+
+    auto introspect(Token_Tree const& tt, std::initializer_list<Introspection_Handler*> handlers) -> void
+    {
+        Introspection_Multiplexer ih{handlers};
+        introspect(tt, ih);
+    }
 }
 
@@ -1,9 +1,13 @@
 #pragma once
 #include "handler.hpp"
 #include "../token-tree/token-tree.hpp"
+#include <initializer_list>
 
 namespace cctt
 {
     auto introspect(Token_Tree const& tt, Introspection_Handler& ih) -> void;
+
+    // Parse once, and deliver every event to each of the handlers.
+    auto introspect(Token_Tree const& tt, std::initializer_list<Introspection_Handler*> handlers) -> void;
 }
 
@@ -0,0 +1,102 @@
+#include "multiplex.hpp"
+#include <exception>
+
+namespace cctt
+{
+    Introspection_Multiplexer::Introspection_Multiplexer(std::initializer_list<Introspection_Handler*> handlers)
+        : handlers{handlers}
+    {}
+
+    auto Introspection_Multiplexer::add(Introspection_Handler& ih) -> void
+    {
+        handlers.emplace_back(&ih);
+    }
+
+    auto Introspection_Multiplexer::empty() -> void
+    {
+        for (auto ih: handlers) ih->empty();
+    }
+
+    auto Introspection_Multiplexer::start() -> void
+    {
+        for (auto ih: handlers) ih->start();
+    }
+
+    auto Introspection_Multiplexer::finish() -> void
+    {
+        for (auto ih: handlers) ih->finish();
+    }
+
+    auto Introspection_Multiplexer::abort() -> void
+    {
+        // Every handler must see abort(), or it may be left in a half-finished state.
+        std::exception_ptr first_error;
+
+        for (auto ih: handlers) {
+            try {
+                ih->abort();
+            }
+            catch (...) {
+                if (!first_error) first_error = std::current_exception();
+            }
+        }
+
+        if (first_error) std::rethrow_exception(first_error);
+    }
+
+    auto Introspection_Multiplexer::add_attributes(Token const* attribs) -> void
+    {
+        for (auto ih: handlers) ih->add_attributes(attribs);
+    }
+
+    auto Introspection_Multiplexer::clear_attributes() -> void
+    {
+        for (auto ih: handlers) ih->clear_attributes();
+    }
+
+    auto Introspection_Multiplexer::enter_namespace(Token const* name_first, Token const* name_last) -> void
+    {
+        for (auto ih: handlers) ih->enter_namespace(name_first, name_last);
+    }
+
+    auto Introspection_Multiplexer::leave_namespace() -> void
+    {
+        for (auto ih: handlers) ih->leave_namespace();
+    }
+
+    auto Introspection_Multiplexer::enter_enum(Token const* name) -> void
+    {
+        for (auto ih: handlers) ih->enter_enum(name);
+    }
+
+    auto Introspection_Multiplexer::leave_enum() -> void
+    {
+        for (auto ih: handlers) ih->leave_enum();
+    }
+
+    auto Introspection_Multiplexer::enumerator(Token const* name) -> void
+    {
+        for (auto ih: handlers) ih->enumerator(name);
+    }
+
+    auto Introspection_Multiplexer::integral_constant(Token const* name) -> void
+    {
+        for (auto ih: handlers) ih->integral_constant(name);
+    }
+
+    auto Introspection_Multiplexer::structure(Token const* name) -> void
+    {
+        for (auto ih: handlers) ih->structure(name);
+    }
+
+    auto Introspection_Multiplexer::parent(Token const* first, Token const* last) -> void
+    {
+        for (auto ih: handlers) ih->parent(first, last);
+    }
+
+    auto Introspection_Multiplexer::variable_or_function(Token const* name) -> void
+    {
+        for (auto ih: handlers) ih->variable_or_function(name);
+    }
+}
+
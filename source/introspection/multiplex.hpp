@@ -0,0 +1,48 @@
+#pragma once
+#include "handler.hpp"
+#include <initializer_list>
+#include <vector>
+
+namespace cctt
+{
+    // Forwards every event to each of the handlers, in the order they are given.
+    //
+    // This allows a single introspect() pass to drive multiple handlers.
+    // abort() is forwarded to all handlers, even if some of them throw;
+    // the first exception thrown will be rethrown after all are notified.
+    struct Introspection_Multiplexer final: Introspection_Handler
+    {
+        Introspection_Multiplexer() = default;
+        Introspection_Multiplexer(std::initializer_list<Introspection_Handler*> handlers);
+
+        auto add(Introspection_Handler& ih) -> void;
+
+        auto empty() -> void override;
+
+        auto start() -> void override;
+        auto finish() -> void override;
+
+        auto abort() -> void override;
+
+        auto add_attributes(Token const* attribs) -> void override;
+        auto clear_attributes() -> void override;
+
+        auto enter_namespace(Token const* name_first, Token const* name_last) -> void override;
+        auto leave_namespace() -> void override;
+
+        auto enter_enum(Token const* name) -> void override;
+        auto leave_enum() -> void override;
+        auto enumerator(Token const* name) -> void override;
+
+        auto integral_constant(Token const* name) -> void override;
+
+        auto structure(Token const* name) -> void override;
+        auto parent(Token const* first, Token const* last) -> void override;
+
+        auto variable_or_function(Token const* name) -> void override;
+
+    private:
+        std::vector<Introspection_Handler*> handlers;
+    };
+}
+
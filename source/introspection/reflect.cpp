@@ -0,0 +1,490 @@
+#include "reflect.hpp"
+#include "../util/string.hpp"
+#include <algorithm>
+#include <numeric>
+#include <cstdint>
+
+namespace cctt
+{
+    namespace
+    {
+        // Everything the generated specializations rely on.
+        // Guarded, so that multiple generated headers can be included together.
+        constexpr char prelude[] = R"prelude(// Generated by cctt. Do not edit.
+#pragma once
+
+#ifndef CCTT_REFLECTION_DETAIL_
+#define CCTT_REFLECTION_DETAIL_
+#include <type_traits>
+#include <cstddef>
+#include <cstdint>
+
+namespace cctt
+{
+    namespace reflection
+    {
+        template <class T, class = void> struct Enum;
+        template <class T, class = void> struct Struct;
+
+        namespace detail
+        {
+            // FNV-1a, seeded. Must match the generator.
+            constexpr auto hash(char const* s, std::size_t n, std::uint32_t seed) -> std::uint32_t
+            {
+                auto h = std::uint32_t(2166136261u ^ seed);
+                for (std::size_t i=0; i < n; i++) {
+                    h ^= std::uint8_t(s[i]);
+                    h *= std::uint32_t(16777619u);
+                }
+                return h;
+            }
+
+            constexpr auto equals(char const* s, std::size_t n, char const* name) -> bool
+            {
+                for (std::size_t i=0; i < n; i++)
+                    if (name[i] != s[i] || name[i] == '\0')
+                        return false;
+                return (name[n] == '\0');
+            }
+
+            // slots[] holds index+1, or 0 for empty slots. M is a power of 2.
+            // Returns N if not found.
+            template <std::size_t N, std::size_t M>
+            constexpr auto find_name(
+                char const* const (&names)[N],
+                std::uint32_t const (&slots)[M],
+                std::uint32_t seed,
+                char const* s,
+                std::size_t n
+            ) -> std::size_t
+            {
+                auto slot = slots[hash(s, n, seed) & (M - 1)];
+                if (slot == 0) return N;
+                return (equals(s, n, names[slot - 1]) ? slot - 1 : N);
+            }
+
+            template <class E>
+            constexpr auto underlying(E x) -> long long
+            {
+                return static_cast<long long>(static_cast<typename std::underlying_type<E>::type>(x));
+            }
+
+            // Enumerator values in ascending order, with the index of each enumerator.
+            // Aliases (enumerators of the same value) keep their declaration order.
+            template <std::size_t N>
+            struct Value_Index
+            {
+                long long value[N];
+                std::size_t index[N];
+            };
+
+            template <class E, std::size_t N>
+            constexpr auto make_value_index(E const (&values)[N]) -> Value_Index<N>
+            {
+                Value_Index<N> vi{};
+                for (std::size_t i=0; i < N; i++) {
+                    auto v = underlying(values[i]);
+                    auto j = i;
+                    for (; j > 0 && vi.value[j-1] > v; j--) {
+                        vi.value[j] = vi.value[j-1];
+                        vi.index[j] = vi.index[j-1];
+                    }
+                    vi.value[j] = v;
+                    vi.index[j] = i;
+                }
+                return vi;
+            }
+
+            // Values are dense if a direct lookup table wastes at most about half of its slots.
+            // Returns the size of such a table, or 0 if values are sparse.
+            template <std::size_t N>
+            constexpr auto dense_span_of(Value_Index<N> const& vi) -> std::size_t
+            {
+                auto span = static_cast<unsigned long long>(vi.value[N-1]) - static_cast<unsigned long long>(vi.value[0]) + 1;
+                return (span <= 2*N + 16 ? std::size_t(span) : 0);
+            }
+
+            // slot[value - min] holds index+1, or 0 for holes.
+            template <std::size_t Span>
+            struct Dense_Index
+            {
+                std::uint32_t slot[Span];
+            };
+
+            template <std::size_t Span, std::size_t N>
+            constexpr auto make_dense_index(Value_Index<N> const& vi, std::size_t span) -> Dense_Index<Span>
+            {
+                Dense_Index<Span> di{};
+                if (span == 0) return di;
+                // Of the aliases, the first declared one wins.
+                for (std::size_t i=0; i < N; i++)
+                    if (i == 0 || vi.value[i] != vi.value[i-1])
+                        di.slot[std::size_t(vi.value[i] - vi.value[0])] = std::uint32_t(vi.index[i] + 1);
+                return di;
+            }
+
+            // Returns N if not found.
+            template <std::size_t N, std::size_t Span>
+            constexpr auto find_value(Value_Index<N> const& vi, Dense_Index<Span> const& di, std::size_t span, long long v) -> std::size_t
+            {
+                if (span != 0) {
+                    if (v < vi.value[0] || v > vi.value[N-1]) return N;
+                    auto slot = di.slot[std::size_t(v - vi.value[0])];
+                    return (slot == 0 ? N : slot - 1);
+                }
+
+                std::size_t first = 0;
+                std::size_t last = N;
+                while (first < last) {
+                    auto mid = first + (last - first) / 2;
+                    if (vi.value[mid] < v) first = mid + 1;
+                    else last = mid;
+                }
+                return (first < N && vi.value[first] == v ? vi.index[first] : N);
+            }
+        }
+    }
+}
+#endif
+)prelude";
+
+        template <std::size_t len>
+        auto write(fmt::memory_buffer& out, char const (&text)[len]) -> void
+        {
+            out.append(text, text + len - 1);
+        }
+
+        // Must match detail::hash() in the prelude.
+        auto hash(std::string const& s, std::uint32_t seed) -> std::uint32_t
+        {
+            auto h = std::uint32_t(2166136261u ^ seed);
+            for (auto ch: s) {
+                h ^= std::uint8_t(ch);
+                h *= std::uint32_t(16777619u);
+            }
+            return h;
+        }
+
+        struct Perfect_Hash
+        {
+            std::uint32_t seed;
+            std::vector<std::uint32_t> slots;   // index+1, or 0 for empty slots
+        };
+
+        // Of duplicated names (e.g. from both branches of an #if), the first one wins.
+        auto make_perfect_hash(std::vector<std::string> const& names) -> Perfect_Hash
+        {
+            constexpr auto seeds_per_size = std::uint32_t(1) << 12;
+
+            auto size = std::size_t(2);
+            while (size < names.size() * 2) size *= 2;
+
+            Perfect_Hash ph;
+            while (true) {
+                for (std::uint32_t seed=0; seed < seeds_per_size; seed++) {
+                    ph.seed = seed;
+                    ph.slots.assign(size, 0);
+
+                    auto ok = true;
+                    for (std::size_t i=0; ok && i < names.size(); i++) {
+                        auto& slot = ph.slots[hash(names[i], seed) & (size - 1)];
+                        if (slot == 0) slot = std::uint32_t(i + 1);
+                        else if (names[slot - 1] != names[i]) ok = false;
+                    }
+
+                    if (ok) return ph;
+                }
+                size *= 2;
+            }
+        }
+
+        auto sorted_indices_of(std::vector<std::string> const& names) -> std::vector<std::size_t>
+        {
+            std::vector<std::size_t> indices(names.size());
+            std::iota(indices.begin(), indices.end(), std::size_t(0));
+            std::sort(indices.begin(), indices.end(), [&] (auto a, auto b) { return names[a] < names[b]; });
+            return indices;
+        }
+
+        // Writes a C++ string literal.
+        auto write_literal(fmt::memory_buffer& out, std::string const& s) -> void
+        {
+            out.push_back('"');
+            util::append_json_escaped(out, s.data(), s.data() + s.size());
+            out.push_back('"');
+        }
+
+        auto write_name_array(fmt::memory_buffer& out, char const* member, std::vector<std::string> const& names) -> void
+        {
+            fmt::format_to(out, "            static constexpr char const* {}[{}] = {{", member, std::max(names.size(), std::size_t(1)));
+            if (names.empty()) write(out, " nullptr,");
+            for (auto& name: names) {
+                write(out, "\n                ");
+                write_literal(out, name);
+                write(out, ",");
+            }
+            write(out, "\n            };\n");
+        }
+
+        auto write_sorted_arrays(fmt::memory_buffer& out, char const* member, std::vector<std::string> const& names) -> void
+        {
+            auto indices = sorted_indices_of(names);
+
+            std::vector<std::string> sorted;
+            sorted.reserve(names.size());
+            for (auto i: indices) sorted.emplace_back(names[i]);
+            write_name_array(out, member, sorted);
+
+            fmt::format_to(out, "            static constexpr std::size_t sorted_indices[{}] = {{", std::max(names.size(), std::size_t(1)));
+            if (names.empty()) write(out, " 0,");
+            for (auto i: indices) fmt::format_to(out, " {},", i);
+            write(out, " };\n");
+        }
+
+        auto write_perfect_hash(fmt::memory_buffer& out, std::vector<std::string> const& names) -> void
+        {
+            auto ph = make_perfect_hash(names);
+            fmt::format_to(out, "            static constexpr std::uint32_t hash_seed = {}u;\n", ph.seed);
+            fmt::format_to(out, "            static constexpr std::uint32_t hash_slots[{}] = {{", ph.slots.size());
+            for (auto slot: ph.slots) fmt::format_to(out, " {},", slot);
+            write(out, " };\n");
+        }
+
+        // Out-of-class definitions, required for odr-used static constexpr members before C++17.
+        auto write_definitions(fmt::memory_buffer& out, char const* kind, std::string const& type, std::initializer_list<char const*> members) -> void
+        {
+            for (auto member: members)
+                fmt::format_to(
+                    out,
+                    "        template <class Dummy> constexpr decltype({0}<{1}, Dummy>::{2}) {0}<{1}, Dummy>::{2};\n",
+                    kind, type, member
+                );
+        }
+    }
+
+    Reflection_Generator::Reflection_Generator(std::ostream& sink)
+        : sink{sink}
+    {}
+
+    auto Reflection_Generator::empty() -> void
+    {
+        write(out, prelude);
+        flush();
+    }
+
+    auto Reflection_Generator::start() -> void
+    {
+        full_namespace.clear();
+        scopes.clear();
+        enums.clear();
+        structs.clear();
+        current_enum = nullptr;
+        pending_struct = nullptr;
+    }
+
+    auto Reflection_Generator::finish() -> void
+    {
+        generate();
+        flush();
+    }
+
+    auto Reflection_Generator::abort() -> void
+    {
+        write(out, "#error \"cctt: introspection aborted, no reflection data generated.\"\n");
+        flush();
+    }
+
+    auto Reflection_Generator::add_attributes(Token const* attribs) -> void
+    {
+    }
+
+    auto Reflection_Generator::clear_attributes() -> void
+    {
+    }
+
+    auto Reflection_Generator::enter_namespace(Token const* name_first, Token const* name_last) -> void
+    {
+        scopes.push_back({full_namespace.size(), pending_struct});
+        pending_struct = nullptr;
+
+        full_namespace += "::";
+        full_namespace.append(name_first->first, name_last[-1].last);
+    }
+
+    auto Reflection_Generator::leave_namespace() -> void
+    {
+        full_namespace.resize(scopes.back().name_size);
+        scopes.pop_back();
+    }
+
+    auto Reflection_Generator::enter_enum(Token const* name) -> void
+    {
+        enums.push_back({qualified_name_of(name), {}});
+        current_enum = &enums.back();
+    }
+
+    auto Reflection_Generator::leave_enum() -> void
+    {
+        current_enum = nullptr;
+    }
+
+    auto Reflection_Generator::enumerator(Token const* name) -> void
+    {
+        current_enum->enumerators.emplace_back(name->first, name->last);
+    }
+
+    auto Reflection_Generator::integral_constant(Token const* name) -> void
+    {
+    }
+
+    auto Reflection_Generator::structure(Token const* name) -> void
+    {
+        structs.push_back({qualified_name_of(name), {}, {}});
+        pending_struct = &structs.back();
+    }
+
+    auto Reflection_Generator::parent(Token const* first, Token const* last) -> void
+    {
+        auto text_last = (first < last ? last[-1].last : first->first);
+        pending_struct->parents.emplace_back(first->first, text_last);
+    }
+
+    auto Reflection_Generator::variable_or_function(Token const* name) -> void
+    {
+        if (scopes.empty() || scopes.back().structure == nullptr) return;
+
+        // Overloaded functions are listed once.
+        auto& members = scopes.back().structure->members;
+        auto first = name->first;
+        auto size = std::size_t(name->last - name->first);
+        auto same_name = [&] (std::string const& member) { return (member.compare(0, std::string::npos, first, size) == 0); };
+        if (std::find_if(members.begin(), members.end(), same_name) == members.end())
+            members.emplace_back(first, size);
+    }
+
+    auto Reflection_Generator::qualified_name_of(Token const* name) const -> std::string
+    {
+        auto qualified_name = full_namespace;
+        qualified_name += "::";
+        qualified_name.append(name->first, name->last);
+        return qualified_name;
+    }
+
+    auto Reflection_Generator::generate() -> void
+    {
+        write(out, prelude);
+        write(out, "\nnamespace cctt\n{\n    namespace reflection\n    {\n");
+
+        for (auto& info: enums)
+            if (!info.enumerators.empty())
+                generate_enum(info);
+
+        for (auto& info: structs)
+            generate_struct(info);
+
+        write(out, "    }\n}\n");
+    }
+
+    auto Reflection_Generator::generate_enum(Enum_Info const& info) -> void
+    {
+        auto& type = info.qualified_name;
+        auto& names = info.enumerators;
+
+        fmt::format_to(out, "        template <class Dummy>\n        struct Enum<{}, Dummy>\n        {{\n", type);
+        fmt::format_to(out, "            using type = {};\n", type);
+        write(out, "            static constexpr char const* qualified_name = ");
+        write_literal(out, type);
+        write(out, ";\n");
+        fmt::format_to(out, "            static constexpr std::size_t count = {};\n", names.size());
+
+        write(out, "            static constexpr type values[count] = {");
+        for (auto& name: names) fmt::format_to(out, "\n                {}::{},", type, name);
+        write(out, "\n            };\n");
+
+        write_name_array(out, "names", names);
+        write_sorted_arrays(out, "sorted_names", names);
+        write_perfect_hash(out, names);
+
+        write(out, R"(
+            static constexpr auto by_value = detail::make_value_index(values);
+            static constexpr auto dense_span = detail::dense_span_of(by_value);
+            static constexpr auto dense = detail::make_dense_index<(dense_span == 0 ? 1 : dense_span)>(by_value, dense_span);
+
+            // Returns count if x is not an enumerator.
+            static constexpr auto index_of(type x) -> std::size_t
+            {
+                return detail::find_value(by_value, dense, dense_span, detail::underlying(x));
+            }
+
+            static constexpr auto to_name(type x) -> char const*
+            {
+                auto i = index_of(x);
+                return (i == count ? nullptr : names[i]);
+            }
+
+            // Returns count if there is no such enumerator.
+            static constexpr auto index_of(char const* name, std::size_t size) -> std::size_t
+            {
+                return detail::find_name(names, hash_slots, hash_seed, name, size);
+            }
+
+            static constexpr auto from_name(char const* name, std::size_t size, type& x) -> bool
+            {
+                auto i = index_of(name, size);
+                if (i == count) return false;
+                x = values[i];
+                return true;
+            }
+        };
+)");
+
+        write_definitions(out, "Enum", type, {
+            "qualified_name", "count", "values", "names", "sorted_names", "sorted_indices",
+            "hash_seed", "hash_slots", "by_value", "dense_span", "dense",
+        });
+        write(out, "\n");
+    }
+
+    auto Reflection_Generator::generate_struct(Struct_Info const& info) -> void
+    {
+        auto& type = info.qualified_name;
+        auto& names = info.members;
+
+        fmt::format_to(out, "        template <class Dummy>\n        struct Struct<{}, Dummy>\n        {{\n", type);
+        fmt::format_to(out, "            using type = {};\n", type);
+        write(out, "            static constexpr char const* qualified_name = ");
+        write_literal(out, type);
+        write(out, ";\n");
+
+        fmt::format_to(out, "            static constexpr std::size_t parent_count = {};\n", info.parents.size());
+        write_name_array(out, "parents", info.parents);
+
+        fmt::format_to(out, "            static constexpr std::size_t member_count = {};\n", names.size());
+        write_name_array(out, "members", names);
+        write_sorted_arrays(out, "sorted_members", names);
+        write_perfect_hash(out, names);
+
+        write(out, R"(
+            // Returns member_count if there is no such member.
+            static constexpr auto index_of(char const* name, std::size_t size) -> std::size_t
+            {
+                return (member_count == 0 ? 0 : detail::find_name(members, hash_slots, hash_seed, name, size));
+            }
+        };
+)");
+
+        write_definitions(out, "Struct", type, {
+            "qualified_name", "parent_count", "parents", "member_count", "members",
+            "sorted_members", "sorted_indices", "hash_seed", "hash_slots",
+        });
+        write(out, "\n");
+    }
+
+    auto Reflection_Generator::flush() -> void
+    {
+        sink.write(out.data(), out.size());
+        sink.flush();
+        out.resize(0);
+    }
+}
+
@@ -0,0 +1,102 @@
+#pragma once
+#include "handler.hpp"
+#include <fmt/format.hpp>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <cstddef>
+
+namespace cctt
+{
+    // Generates a C++14 header with compile-time reflection data
+    // for every introspected enum and struct:
+    //
+    //   cctt::reflection::Enum<E>::count
+    //   cctt::reflection::Enum<E>::values[]          declaration order
+    //   cctt::reflection::Enum<E>::names[]           declaration order
+    //   cctt::reflection::Enum<E>::sorted_names[]    lexicographical order
+    //   cctt::reflection::Enum<E>::sorted_indices[]  sorted_names[i] == names[sorted_indices[i]]
+    //   cctt::reflection::Enum<E>::to_name(e)        nullptr if e is not an enumerator
+    //   cctt::reflection::Enum<E>::from_name(s, n, e) -> bool
+    //
+    //   cctt::reflection::Struct<S>::parents[]       text of the public bases
+    //   cctt::reflection::Struct<S>::members[]       public data members and functions, declaration order
+    //   cctt::reflection::Struct<S>::sorted_members[], sorted_indices[]
+    //   cctt::reflection::Struct<S>::index_of(s, n)  member_count if there is no such member
+    //
+    // Name lookups use a perfect hash computed by the generator,
+    // enum value lookups use a dense table computed at compile time
+    // (falling back to a binary search when the values are sparse).
+    // None of them allocates.
+    //
+    // Class templates cannot be named without their arguments, thus are not supported.
+    //
+    // The header is written to the sink on finish().
+    // On abort(), an #error directive is written instead.
+    struct Reflection_Generator final: Introspection_Handler
+    {
+        Reflection_Generator(std::ostream& sink=std::cout);
+
+        auto empty() -> void override;
+
+        auto start() -> void override;
+        auto finish() -> void override;
+
+        auto abort() -> void override;
+
+        auto add_attributes(Token const* attribs) -> void override;
+        auto clear_attributes() -> void override;
+
+        auto enter_namespace(Token const* name_first, Token const* name_last) -> void override;
+        auto leave_namespace() -> void override;
+
+        auto enter_enum(Token const* name) -> void override;
+        auto leave_enum() -> void override;
+        auto enumerator(Token const* name) -> void override;
+
+        auto integral_constant(Token const* name) -> void override;
+
+        auto structure(Token const* name) -> void override;
+        auto parent(Token const* first, Token const* last) -> void override;
+
+        auto variable_or_function(Token const* name) -> void override;
+
+    private:
+        struct Enum_Info
+        {
+            std::string qualified_name;
+            std::vector<std::string> enumerators;
+        };
+
+        struct Struct_Info
+        {
+            std::string qualified_name;
+            std::vector<std::string> parents;
+            std::vector<std::string> members;
+        };
+
+        struct Scope
+        {
+            std::size_t name_size;  // full_namespace.size() before entering
+            Struct_Info* structure; // nullptr for namespaces
+        };
+
+        std::ostream& sink;
+        fmt::memory_buffer out;
+
+        std::string full_namespace;
+        std::vector<Scope> scopes;
+        std::deque<Enum_Info> enums;
+        std::deque<Struct_Info> structs;
+        Enum_Info* current_enum{};
+        Struct_Info* pending_struct{};
+
+        auto qualified_name_of(Token const* name) const -> std::string;
+        auto generate() -> void;
+        auto generate_enum(Enum_Info const& info) -> void;
+        auto generate_struct(Struct_Info const& info) -> void;
+        auto flush() -> void;
+    };
+}
+
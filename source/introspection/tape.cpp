@@ -0,0 +1,194 @@
+#include "tape.hpp"
+#include "introspect.hpp"
+#include "../token-tree/error.hpp"
+#include <cstring>
+
+namespace cctt
+{
+    namespace
+    {
+        // Number of tokens of each event.
+        auto arity_of(Introspection_Event event) -> std::size_t
+        {
+            switch (event) {
+                case Introspection_Event::add_attributes:
+                case Introspection_Event::enter_enum:
+                case Introspection_Event::enumerator:
+                case Introspection_Event::integral_constant:
+                case Introspection_Event::structure:
+                case Introspection_Event::variable_or_function:
+                    return 1;
+
+                case Introspection_Event::enter_namespace:
+                case Introspection_Event::parent:
+                    return 2;
+
+                default:
+                    return 0;
+            }
+        }
+
+        auto token_count_of(Token_Tree const& tt) -> std::size_t
+        {
+            return std::size_t(tt.end() - tt.begin()) + 1;
+        }
+    }
+
+    Introspection_Recorder::Introspection_Recorder(Token_Tree const& tt, Introspection_Tape& tape)
+        : base{tt.begin()}
+        , tape{tape}
+    {}
+
+    auto Introspection_Recorder::empty() -> void { record(Introspection_Event::empty); }
+    auto Introspection_Recorder::start() -> void { record(Introspection_Event::start); }
+    auto Introspection_Recorder::finish() -> void { record(Introspection_Event::finish); }
+    auto Introspection_Recorder::abort() -> void { record(Introspection_Event::abort); }
+
+    auto Introspection_Recorder::add_attributes(Token const* attribs) -> void { record(Introspection_Event::add_attributes, attribs); }
+    auto Introspection_Recorder::clear_attributes() -> void { record(Introspection_Event::clear_attributes); }
+
+    auto Introspection_Recorder::enter_namespace(Token const* name_first, Token const* name_last) -> void { record(Introspection_Event::enter_namespace, name_first, name_last); }
+    auto Introspection_Recorder::leave_namespace() -> void { record(Introspection_Event::leave_namespace); }
+
+    auto Introspection_Recorder::enter_enum(Token const* name) -> void { record(Introspection_Event::enter_enum, name); }
+    auto Introspection_Recorder::leave_enum() -> void { record(Introspection_Event::leave_enum); }
+    auto Introspection_Recorder::enumerator(Token const* name) -> void { record(Introspection_Event::enumerator, name); }
+
+    auto Introspection_Recorder::integral_constant(Token const* name) -> void { record(Introspection_Event::integral_constant, name); }
+
+    auto Introspection_Recorder::structure(Token const* name) -> void { record(Introspection_Event::structure, name); }
+    auto Introspection_Recorder::parent(Token const* first, Token const* last) -> void { record(Introspection_Event::parent, first, last); }
+
+    auto Introspection_Recorder::variable_or_function(Token const* name) -> void { record(Introspection_Event::variable_or_function, name); }
+
+    auto Introspection_Recorder::record(Introspection_Event event) -> void
+    {
+        tape.words.push_back(std::uint32_t(event));
+    }
+
+    auto Introspection_Recorder::record(Introspection_Event event, Token const* tk) -> void
+    {
+        tape.words.push_back(std::uint32_t(event));
+        tape.words.push_back(std::uint32_t(tk - base));
+    }
+
+    auto Introspection_Recorder::record(Introspection_Event event, Token const* first, Token const* last) -> void
+    {
+        tape.words.push_back(std::uint32_t(event));
+        tape.words.push_back(std::uint32_t(first - base));
+        tape.words.push_back(std::uint32_t(last - base));
+    }
+
+    auto record_introspection(Token_Tree const& tt, Introspection_Handler& ih, Introspection_Tape& tape) -> void
+    {
+        tape.clear();
+        Introspection_Recorder recorder{tt, tape};
+
+        try {
+            introspect(tt, {&recorder, &ih});
+        }
+        catch (Parsing_Error const& e) {
+            tape.error = e.what();
+            throw;
+        }
+    }
+
+    auto replay_introspection(Token_Tree const& tt, Introspection_Tape const& tape, Introspection_Handler& ih) -> void
+    {
+        auto tk = [&] (std::uint32_t i) { return tt.begin() + i; };
+
+        for (auto p=tape.words.data(), last=p + tape.words.size(); p < last; ) {
+            auto event = Introspection_Event(*p++);
+
+            switch (event) {
+                case Introspection_Event::empty: ih.empty(); break;
+                case Introspection_Event::start: ih.start(); break;
+                case Introspection_Event::finish: ih.finish(); break;
+
+                case Introspection_Event::abort: ih.abort(); break;
+
+                case Introspection_Event::add_attributes: ih.add_attributes(tk(p[0])); break;
+                case Introspection_Event::clear_attributes: ih.clear_attributes(); break;
+
+                case Introspection_Event::enter_namespace: ih.enter_namespace(tk(p[0]), tk(p[1])); break;
+                case Introspection_Event::leave_namespace: ih.leave_namespace(); break;
+
+                case Introspection_Event::enter_enum: ih.enter_enum(tk(p[0])); break;
+                case Introspection_Event::leave_enum: ih.leave_enum(); break;
+                case Introspection_Event::enumerator: ih.enumerator(tk(p[0])); break;
+
+                case Introspection_Event::integral_constant: ih.integral_constant(tk(p[0])); break;
+
+                case Introspection_Event::structure: ih.structure(tk(p[0])); break;
+                case Introspection_Event::parent: ih.parent(tk(p[0]), tk(p[1])); break;
+
+                case Introspection_Event::variable_or_function: ih.variable_or_function(tk(p[0])); break;
+
+                case Introspection_Event::last_event_: break;
+            }
+
+            p += arity_of(event);
+        }
+
+        if (!tape.error.empty()) throw Parsing_Error{tape.error};
+    }
+
+    auto save_introspection_tape(Token_Tree const& tt, Introspection_Tape const& tape, std::string& out) -> void
+    {
+        Introspection_Tape_Header header{};
+        header.magic = Introspection_Tape_Header::current_magic;
+        header.version = Introspection_Tape_Header::current_version;
+        header.token_count = token_count_of(tt);
+        header.word_count = tape.words.size();
+        header.error_size = tape.error.size();
+
+        out.append(reinterpret_cast<char const*>(&header), sizeof(header));
+        out.append(reinterpret_cast<char const*>(tape.words.data()), tape.words.size() * sizeof(std::uint32_t));
+        out.append(tape.error);
+    }
+
+    auto load_introspection_tape(Token_Tree const& tt, char const* first, char const* last, Introspection_Tape& tape) -> bool
+    {
+        tape.clear();
+
+        auto size = std::size_t(last - first);
+        if (size < sizeof(Introspection_Tape_Header)) return false;
+
+        Introspection_Tape_Header header;
+        std::memcpy(&header, first, sizeof(header));
+        first += sizeof(header);
+        size -= sizeof(header);
+
+        if (header.magic != Introspection_Tape_Header::current_magic) return false;
+        if (header.version != Introspection_Tape_Header::current_version) return false;
+        if (header.token_count != token_count_of(tt)) return false;
+        if (header.word_count > size / sizeof(std::uint32_t)) return false;
+        if (header.error_size != size - header.word_count * sizeof(std::uint32_t)) return false;
+
+        tape.words.resize(std::size_t(header.word_count));
+        std::memcpy(tape.words.data(), first, tape.words.size() * sizeof(std::uint32_t));
+        tape.error.assign(first + tape.words.size() * sizeof(std::uint32_t), std::size_t(header.error_size));
+
+        auto is_valid = [&] {
+            for (std::size_t i=0; i < tape.words.size(); ) {
+                auto event = tape.words[i++];
+                if (event >= std::uint32_t(Introspection_Event::last_event_)) return false;
+
+                auto arity = arity_of(Introspection_Event(event));
+                if (tape.words.size() - i < arity) return false;
+
+                for (; arity != 0; arity--)
+                    if (tape.words[i++] >= header.token_count)
+                        return false;
+            }
+            return true;
+        };
+
+        // Enough for replaying safely.
+        if (is_valid()) return true;
+
+        tape.clear();
+        return false;
+    }
+}
+
@@ -0,0 +1,123 @@
+#pragma once
+#include "handler.hpp"
+#include "../token-tree/token-tree.hpp"
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace cctt
+{
+    enum struct Introspection_Event: std::uint32_t
+    {
+        empty,
+        start,
+        finish,
+        abort,
+        add_attributes,
+        clear_attributes,
+        enter_namespace,
+        leave_namespace,
+        enter_enum,
+        leave_enum,
+        enumerator,
+        integral_constant,
+        structure,
+        parent,
+        variable_or_function,
+
+        last_event_,
+    };
+
+    // The events of one introspect() run over a tree, with tokens as indices into the tree.
+    // Each event is a word of Introspection_Event, followed by a word for each of its tokens.
+    struct Introspection_Tape final
+    {
+        std::vector<std::uint32_t> words;
+
+        // The message of the Parsing_Error thrown by introspect(), if any.
+        // It may be thrown before Introspection_Event::start, with no abort.
+        std::string error;
+
+        auto is_empty() const -> bool
+        {
+            return (words.empty() && error.empty());
+        }
+
+        auto clear() -> void
+        {
+            words.clear();
+            error.clear();
+        }
+    };
+
+    // Records the events into tape, which must be cleared first.
+    struct Introspection_Recorder final: Introspection_Handler
+    {
+        Introspection_Recorder(Token_Tree const& tt, Introspection_Tape& tape);
+
+        auto empty() -> void override;
+
+        auto start() -> void override;
+        auto finish() -> void override;
+
+        auto abort() -> void override;
+
+        auto add_attributes(Token const* attribs) -> void override;
+        auto clear_attributes() -> void override;
+
+        auto enter_namespace(Token const* name_first, Token const* name_last) -> void override;
+        auto leave_namespace() -> void override;
+
+        auto enter_enum(Token const* name) -> void override;
+        auto leave_enum() -> void override;
+        auto enumerator(Token const* name) -> void override;
+
+        auto integral_constant(Token const* name) -> void override;
+
+        auto structure(Token const* name) -> void override;
+        auto parent(Token const* first, Token const* last) -> void override;
+
+        auto variable_or_function(Token const* name) -> void override;
+
+    private:
+        Token const* base;
+        Introspection_Tape& tape;
+
+        auto record(Introspection_Event event) -> void;
+        auto record(Introspection_Event event, Token const* tk) -> void;
+        auto record(Introspection_Event event, Token const* first, Token const* last) -> void;
+    };
+
+    // Same as introspect(tt, ih), also recording the events into tape (which is cleared first).
+    auto record_introspection(Token_Tree const& tt, Introspection_Handler& ih, Introspection_Tape& tape) -> void;
+
+    // Deliver the events of tape, recorded over a tree with the same tokens as tt, to ih.
+    // Throws Parsing_Error as the recorded introspect() did, without parsing anything.
+    auto replay_introspection(Token_Tree const& tt, Introspection_Tape const& tape, Introspection_Handler& ih) -> void;
+
+    // A tape file, in host byte order:
+    //
+    //   Introspection_Tape_Header
+    //   u32  words [word_count]
+    //   char error [error_size]
+    struct Introspection_Tape_Header final
+    {
+        static constexpr std::uint32_t current_magic = 0x45544343;     // "CCTE"
+        static constexpr std::uint32_t current_version = 1;
+
+        std::uint32_t magic;
+        std::uint32_t version;
+        std::uint64_t token_count;      // of the tree, including the end token
+        std::uint64_t word_count;
+        std::uint64_t error_size;
+    };
+
+    // Appends tape, recorded over tt, to out.
+    auto save_introspection_tape(Token_Tree const& tt, Introspection_Tape const& tape, std::string& out) -> void;
+
+    // Load a tape saved by save_introspection_tape() from [first, last), to be replayed over tt.
+    // Returns false, leaving tape cleared, if the data is malformed or does not fit tt.
+    auto load_introspection_tape(Token_Tree const& tt, char const* first, char const* last, Introspection_Tape& tape) -> bool;
+}
+
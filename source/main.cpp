@@ -1,10 +1,19 @@
+#include "cli/options.hpp"
+#include "cli/process.hpp"
+#include "cli/server.hpp"
+#include "cli/watch.hpp"
+#include "cli/dedup.hpp"
+#include "cli/includes.hpp"
 #include "util/file.hpp"
 #include "token-tree/token-tree.hpp"
 #include "token-tree/error.hpp"
-#include "token-tree/pretty-print.hpp"
-#include "introspection/introspect.hpp"
-#include "introspection/dump.hpp"
+#include "token-tree/cache.hpp"
+#include "token-tree/shared.hpp"
+#include "introspection/tape.hpp"
 #include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
 #include <iostream>
 #include <stdexcept>
 
@@ -12,41 +21,147 @@
 
 int main(int argc, char* argv[])
 {
+    // A source and what is built from it.
+    struct Input final
+    {
+        std::string source;
+        cctt::Token_Tree tt;
+        cctt::Token_Tree_Diagnostics diagnostics;
+
+        // Introspection events, for replaying them to other paths with the same source.
+        cctt::Introspection_Tape tape;
+
+        bool has_tree = false;
+    };
+
     std::string path{"@builtin"};
-    std::string source{
+
+    // Reused across files, so that their memory is allocated only once.
+    Input input;
+    input.source = {
         #include "test-source.inl"
     };
 
-    auto scan = [&] {
-        try {
-            cctt::Token_Tree tt{source};
+    nonstd::optional<cctt::Token_Tree_Cache> cache;
+    cctt::Shared_Trees_Builder shared;
+    std::string tape_file;
 
-            cctt::pretty_print_token_tree(tt.begin(), tt.end());
-            std::cout.flush();
+    // The tree of --diff, which the others are compared with.
+    std::string old_source;
+    cctt::Token_Tree old_tt;
+    cctt::Token_Tree_Diagnostics old_diagnostics;
 
-            cctt::Introspection_Dumper handler;
-            cctt::introspect(tt, handler);
+    // Process path, whose source is in in.
+    // If is_duplicate, in was processed for another path first, and its tree and tape are reused.
+    // If has_duplicates, the introspection events are recorded into in.tape for them.
+    auto scan = [&] (cctt::cli::Options const& opts, Input& in, bool is_duplicate, bool has_duplicates) {
+        if (!is_duplicate) {
+            in.has_tree = cctt::cli::build_token_tree(opts, path, in.source, in.tt, in.diagnostics, (cache ? &*cache : nullptr), std::clog);
+        } else if (!in.has_tree) {
+            // Only to report the same error for this path.
+            cctt::cli::build_token_tree(opts, path, in.source, in.tt, in.diagnostics, nullptr, std::clog);
+        } else if (opts.recover) {
+            cctt::cli::report_diagnostics(std::clog, path, in.diagnostics);
         }
-        catch (cctt::Parsing_Error const& e) {
-            std::clog
-                << STYLE_ERROR "Error" STYLE_NORMAL " parsing "
-                << STYLE_PATH << path << STYLE_NORMAL
-                << " at " << e.what()
-                << "\n";
-            std::clog.flush();
+        if (!in.has_tree) return;
+
+        if (!opts.publish.empty()) shared.add(path, in.tt);
+        if (!opts.diff_from.empty()) cctt::cli::write_diff(opts.diff_from, old_tt, path, in.tt, std::cout);
+
+        if (is_duplicate) {
+            cctt::cli::write_outputs(opts, path, in.tt, std::cout, std::clog, &in.tape);
+            return;
+        }
+
+        // With a cache, introspection is replayed from the tape of the same source, if any.
+        auto is_cached = (cache && !opts.recover);
+        if (!is_cached && !has_duplicates) {
+            cctt::cli::write_outputs(opts, path, in.tt, std::cout, std::clog);
+            return;
+        }
+
+        auto has_tape = (
+            is_cached
+            && cache->load_attachment(in.source, "tape", tape_file)
+            && cctt::load_introspection_tape(in.tt, tape_file.data(), tape_file.data() + tape_file.size(), in.tape)
+        );
+        if (!has_tape) in.tape.clear();
+
+        cctt::cli::write_outputs(opts, path, in.tt, std::cout, std::clog, &in.tape);
+
+        if (is_cached && !has_tape && !in.tape.is_empty()) {
+            tape_file.clear();
+            cctt::save_introspection_tape(in.tt, in.tape, tape_file);
+            cache->store_attachment(in.source, "tape", tape_file);
         }
     };
 
     try {
-        if (argc < 2) {
-            scan();
+        auto opts = cctt::cli::parse_options(argc, argv);
+
+        if (!opts.serve.empty()) {
+            cctt::cli::run_server(opts.serve.data(), opts.workers);
+            return 0;
+        }
+
+        if (!opts.connect.empty()) {
+            // Everything else is for the server.
+            std::vector<std::string> args;
+            for (int i=1; i < argc; i++)
+                if (!cctt::cli::is_connect_option(argv[i]))
+                    args.emplace_back(argv[i]);
+            cctt::cli::run_client(opts.connect.data(), args);
+            return 0;
+        }
+
+        if (!opts.cache_dir.empty()) cache.emplace(opts.cache_dir, opts.cache_size_mib << 20);
+
+        if (!opts.diff_from.empty()) {
+            cctt::util::slurp(opts.diff_from.data(), old_source);
+            if (!cctt::cli::build_token_tree(opts, opts.diff_from, old_source, old_tt, old_diagnostics, (cache ? &*cache : nullptr), std::clog))
+                return 0;
+        }
+
+        if (opts.follow_includes) {
+            cctt::cli::run_follow_includes(opts);
+            return 0;
+        }
+
+        if (opts.watch) {
+            cctt::cli::run_watch(opts, (cache ? &*cache : nullptr));
+            return 0;
+        }
+
+        if (opts.paths.empty()) {
+            scan(opts, input, false, false);
         } else {
-            for (int i=1; i < argc; i++) {
-                path = argv[i];
-                source = cctt::util::slurp(path.data());
-                scan();
+            // Paths with the same contents share the input of their first path, until their last one.
+            auto inputs = cctt::cli::find_identical_inputs(opts.paths);
+            std::unordered_map<std::size_t, std::unique_ptr<Input>> shared_inputs;
+
+            for (std::size_t i=0; i < opts.paths.size(); i++) {
+                path = opts.paths[i];
+
+                auto& group = inputs[i];
+                if (group.first == group.last) {
+                    cctt::util::slurp(path.data(), input.source);
+                    scan(opts, input, false, false);
+                    continue;
+                }
+
+                auto& in = shared_inputs[group.first];
+                auto is_duplicate = bool(in);
+                if (!is_duplicate) {
+                    in.reset(new Input);
+                    cctt::util::slurp(path.data(), in->source);
+                }
+
+                scan(opts, *in, is_duplicate, true);
+                if (i == group.last) shared_inputs.erase(group.first);
             }
         }
+
+        if (!opts.publish.empty()) shared.publish(opts.publish.data());
     }
     catch (std::runtime_error const& e) {
         std::clog << STYLE_ERROR << e.what() << STYLE_NORMAL << "\n";
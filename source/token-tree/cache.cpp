@@ -0,0 +1,195 @@
+#include "cache.hpp"
+#include "serialize.hpp"
+#include "../util/hash.hpp"
+#include "../util/mapped-file.hpp"
+#include <fmt/format.hpp>
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace cctt
+{
+    namespace
+    {
+        // Every file in the cache has a name with this (followed by its kind), except temporary files.
+        constexpr char const* kind_prefix = ".cctt-";
+        constexpr char const* temporary_suffix = ".tmp";
+
+        auto hash_of(std::string const& source) -> std::uint64_t
+        {
+            return util::hash64(source.data(), source.size());
+        }
+
+        auto ends_with(char const* x, char const* tail) -> bool
+        {
+            auto n = std::strlen(x);
+            auto m = std::strlen(tail);
+            return (n >= m && std::strcmp(x + n - m, tail) == 0);
+        }
+
+        auto is_cache_file(char const* name) -> bool
+        {
+            return (std::strstr(name, kind_prefix) != nullptr && !ends_with(name, temporary_suffix));
+        }
+
+        auto write_all(int fd, char const* data, std::size_t size) -> bool
+        {
+            while (size != 0) {
+                auto n = ::write(fd, data, size);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) return false;
+                data += n;
+                size -= std::size_t(n);
+            }
+            return true;
+        }
+    }
+
+    Token_Tree_Cache::Token_Tree_Cache(std::string directory, std::uint64_t max_bytes)
+        : directory{std::move(directory)}
+        , max_bytes{max_bytes}
+    {
+        if (::mkdir(this->directory.data(), 0777) != 0 && errno != EEXIST)
+            throw std::runtime_error{"Cannot create cache directory: " + this->directory};
+    }
+
+    auto Token_Tree_Cache::load(Token_Tree& tt, std::string const& source) -> bool
+    {
+        auto hash = hash_of(source);
+        auto path = path_of(source, hash);
+
+        util::Mapped_File file{path.data()};
+        if (file.data() == nullptr || file.size() < sizeof(Serialized_Tree_Header)) return false;
+
+        Serialized_Tree_Header header;
+        std::memcpy(&header, file.data(), sizeof(header));
+        if (header.source_hash != hash) return false;
+
+        if (!tt.try_load(source.data(), file.data(), file.data() + file.size())) return false;
+
+        // Mark as recently used.
+        ::utimensat(AT_FDCWD, path.data(), nullptr, 0);
+        return true;
+    }
+
+    auto Token_Tree_Cache::store(Token_Tree const& tt, std::string const& source) -> void
+    {
+        auto hash = hash_of(source);
+        auto path = path_of(source, hash);
+
+        std::string data;
+        try {
+            save_token_tree(tt, hash, data);
+        }
+        catch (std::length_error const&) {
+            return;
+        }
+
+        write(path, data);
+    }
+
+    auto Token_Tree_Cache::load_attachment(std::string const& source, char const* kind, std::string& data) -> bool
+    {
+        auto path = path_of(source, hash_of(source), kind);
+
+        util::Mapped_File file{path.data()};
+        if (file.data() == nullptr) return false;
+
+        data.assign(file.data(), file.size());
+
+        // Mark as recently used.
+        ::utimensat(AT_FDCWD, path.data(), nullptr, 0);
+        return true;
+    }
+
+    auto Token_Tree_Cache::store_attachment(std::string const& source, char const* kind, std::string const& data) -> void
+    {
+        write(path_of(source, hash_of(source), kind), data);
+    }
+
+    auto Token_Tree_Cache::path_of(std::string const& source, std::uint64_t hash, char const* kind) const -> std::string
+    {
+        return fmt::format("{}/{:016x}-{:x}{}{}", directory, hash, source.size(), kind_prefix, kind);
+    }
+
+    auto Token_Tree_Cache::write(std::string const& path, std::string const& data) -> void
+    {
+        auto temp_path = fmt::format("{}.{}{}", path, ::getpid(), temporary_suffix);
+        auto fd = ::open(temp_path.data(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        if (fd < 0) return;
+
+        auto ok = write_all(fd, data.data(), data.size());
+        ok = (::close(fd) == 0) && ok;
+
+        // The file replaced, if any, is no longer counted.
+        struct stat st;
+        auto replaced_size = (::stat(path.data(), &st) == 0 ? std::uint64_t(st.st_size) : 0);
+
+        if (!ok || ::rename(temp_path.data(), path.data()) != 0) {
+            ::unlink(temp_path.data());
+            return;
+        }
+
+        if (used_bytes != unknown_bytes) {
+            used_bytes = used_bytes - std::min(used_bytes, replaced_size) + data.size();
+            if (used_bytes <= max_bytes) return;
+        }
+
+        evict();
+    }
+
+    auto Token_Tree_Cache::evict() -> void
+    {
+        struct Entry final
+        {
+            std::string path;
+            std::uint64_t size;
+            struct timespec used;
+        };
+
+        auto dir = ::opendir(directory.data());
+        if (dir == nullptr) return;
+
+        std::vector<Entry> entries;
+        std::uint64_t total{};
+
+        while (auto ent = ::readdir(dir)) {
+            if (!is_cache_file(ent->d_name)) continue;
+
+            auto path = directory + "/" + ent->d_name;
+            struct stat st;
+            if (::stat(path.data(), &st) != 0) continue;
+
+            total += std::uint64_t(st.st_size);
+            entries.push_back({ std::move(path), std::uint64_t(st.st_size), st.st_mtim });
+        }
+
+        ::closedir(dir);
+
+        used_bytes = total;
+        if (total <= max_bytes) return;
+
+        // Leave room for the next stores, so that the directory is not listed again at each of them.
+        auto target_bytes = max_bytes - max_bytes / 10;
+
+        std::sort(entries.begin(), entries.end(), [] (Entry const& a, Entry const& b) {
+            if (a.used.tv_sec != b.used.tv_sec) return (a.used.tv_sec < b.used.tv_sec);
+            return (a.used.tv_nsec < b.used.tv_nsec);
+        });
+
+        for (auto& e: entries) {
+            if (total <= target_bytes) break;
+            if (::unlink(e.path.data()) == 0) total -= e.size;
+        }
+
+        used_bytes = total;
+    }
+}
+
@@ -0,0 +1,49 @@
+#pragma once
+#include "token-tree.hpp"
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+namespace cctt
+{
+    // A directory of serialized token trees (see serialize.hpp), keyed by a hash of their sources.
+    //
+    // When the files in the directory take more than max_bytes,
+    // the least recently used ones are removed, down to 90% of max_bytes. (A hit counts as a use.)
+    // The directory is listed only then, and once at the first store.
+    //
+    // Several processes may share a directory: files are written to a temporary name and renamed.
+    struct Token_Tree_Cache final
+    {
+        // The directory is created if it does not exist.
+        // Throws std::runtime_error if it cannot be created.
+        Token_Tree_Cache(std::string directory, std::uint64_t max_bytes=std::uint64_t(256) << 20);
+
+        // Load the tree of source into tt.
+        // Returns false on a miss, leaving tt empty.
+        auto load(Token_Tree& tt, std::string const& source) -> bool;
+
+        // Store tt, which must have been built from source.
+        // Failures (e.g. a full disk) are ignored, as the cache is only an optimization.
+        auto store(Token_Tree const& tt, std::string const& source) -> void;
+
+        // Other data about source (e.g. an introspection tape), stored as its own file
+        // under kind (e.g. "tape"), and evicted like trees. The data is not checked.
+        auto load_attachment(std::string const& source, char const* kind, std::string& data) -> bool;
+        auto store_attachment(std::string const& source, char const* kind, std::string const& data) -> void;
+
+    private:
+        std::string directory;
+        std::uint64_t max_bytes;
+
+        // The size of the files in the directory, as counted by the last evict(), plus the stores since then;
+        // unknown_bytes before the first count. Stores by other processes are only seen at the next count.
+        static constexpr std::uint64_t unknown_bytes = ~std::uint64_t{};
+        std::uint64_t used_bytes{unknown_bytes};
+
+        auto path_of(std::string const& source, std::uint64_t hash, char const* kind="tree") const -> std::string;
+        auto write(std::string const& path, std::string const& data) -> void;
+        auto evict() -> void;
+    };
+}
+
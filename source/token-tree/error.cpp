@@ -1,19 +1,108 @@
 #include "error.hpp"
 #include "../util/string.hpp"
 #include <fmt/format.hpp>
+#include <cstring>
 
 #include "../util/style.inl"
 
 namespace cctt
 {
-    [[noreturn]] auto throw_scanning_error(
+    namespace
+    {
+        // Same as Token_Tree::source_location_of(), but without the start-of-line index.
+        auto source_location_of(char const* source, std::size_t offset) -> Source_Location
+        {
+            auto at = source + offset;
+            auto sol = source;
+            std::size_t line{1};
+
+            for (auto p=source; (p = static_cast<char const*>(std::memchr(p, '\n', std::size_t(at - p)))); sol = ++p)
+                line++;
+
+            return { line, std::size_t(at - sol + 1) };
+        }
+
+        auto missing_pair_of(Token_Tree_Error const& e) -> std::string
+        {
+            using Kind = Token_Tree_Error_Kind;
+            auto first = e.source + e.at.first;
+            auto last = e.source + e.at.last;
+
+            switch (e.kind) {
+                case Kind::unterminated_literal: return {first, 1};
+                case Kind::unterminated_comment: return "*/";
+
+                // [first, last) is R"DELIMITER( with any prefix,
+                // where `(` is missing if DELIMITER is too long.
+                case Kind::unterminated_raw_string: {
+                    auto delimiter = static_cast<char const*>(std::memchr(first, '"', std::size_t(last - first))) + 1;
+                    if (last[-1] == '(') last--;
+                    return ")" + std::string{delimiter, last} + "\"";
+                }
+
+                case Kind::missing_closing_pair:
+                    switch (*first) {
+                        case '(': return ")";
+                        case '[': return "]";
+                        case '{': return "}";
+                        default: return ">";
+                    }
+
+                case Kind::missing_open_pair:
+                    switch (*first) {
+                        case ')': return "(";
+                        case ']': return "[";
+                        case '}': return "{";
+                        default: return "<";
+                    }
+
+                default: return {};
+            }
+        }
+    }
+
+    auto Token_Tree_Error::message() const -> std::string
+    {
+        using Kind = Token_Tree_Error_Kind;
+        auto loc = source_location_of(source, at.first);
+        auto first = source + at.first;
+        auto last = source + at.last;
+
+        switch (kind) {
+            case Kind::none:
+                return {};
+
+            case Kind::unknown_character:
+                return format_scanning_error(loc, first, last, "unknown character.");
+
+            case Kind::incomplete_raw_string:
+                return format_scanning_error(loc, first, last, "raw string requires R\"DELIMITER( )DELIMITER\"");
+
+            case Kind::invalid_raw_string_delimiter:
+                return format_scanning_error(loc, first, last, "invalid raw string delimiter.");
+
+            case Kind::unpaired_pair: {
+                auto other_loc = source_location_of(source, other.first);
+                return format_scanning_error2(
+                    loc, first, last,
+                    other_loc, source + other.first, source + other.last,
+                    "unmatching pair."
+                );
+            }
+
+            default:
+                return format_scanning_error_of_missing_pair(loc, first, last, missing_pair_of(*this).data());
+        }
+    }
+
+    auto format_scanning_error(
         Source_Location loc,
         char const* first,
         char const* last,
         char const* reason
-    ) -> void
+    ) -> std::string
     {
-        auto msg = fmt::format(
+        return fmt::format(
             STYLE_LOCATION "{}:{}" STYLE_NORMAL " "
             "\"" STYLE_SOURCE "{}" STYLE_NORMAL "\": {}"
             , loc.line
@@ -21,21 +110,66 @@ namespace cctt
             , util::quote_without_delimiters({first, last})
             , reason
         );
-        throw Parsing_Error{msg};
     }
 
-    [[noreturn]] auto throw_scanning_error_of_missing_pair(
+    auto format_scanning_error_of_missing_pair(
         Source_Location loc,
         char const* first,
         char const* last,
         char const* missing_pair
-    ) -> void
+    ) -> std::string
     {
         auto reason = fmt::format(
             "missing paired \"" STYLE_SOURCE "{}" STYLE_NORMAL "\"."
             , util::quote_without_delimiters(missing_pair)
         );
-        throw_scanning_error(loc, first, last, reason.data());
+        return format_scanning_error(loc, first, last, reason.data());
+    }
+
+    auto format_scanning_error2(
+        Source_Location loc0,
+        char const* first0,
+        char const* last0,
+        Source_Location loc1,
+        char const* first1,
+        char const* last1,
+        char const* reason
+    ) -> std::string
+    {
+        return fmt::format(
+            STYLE_LOCATION "{}:{}" STYLE_NORMAL " "
+            "\"" STYLE_SOURCE "{}" STYLE_NORMAL "\" and "
+            STYLE_LOCATION "{}:{}" STYLE_NORMAL " "
+            "\"" STYLE_SOURCE "{}" STYLE_NORMAL "\": "
+            "{}"
+            , loc0.line
+            , loc0.column
+            , util::quote_without_delimiters({first0, last0})
+            , loc1.line
+            , loc1.column
+            , util::quote_without_delimiters({first1, last1})
+            , reason
+        );
+    }
+
+    [[noreturn]] auto throw_scanning_error(
+        Source_Location loc,
+        char const* first,
+        char const* last,
+        char const* reason
+    ) -> void
+    {
+        throw Parsing_Error{format_scanning_error(loc, first, last, reason)};
+    }
+
+    [[noreturn]] auto throw_scanning_error_of_missing_pair(
+        Source_Location loc,
+        char const* first,
+        char const* last,
+        char const* missing_pair
+    ) -> void
+    {
+        throw Parsing_Error{format_scanning_error_of_missing_pair(loc, first, last, missing_pair)};
     }
 
     [[noreturn]] auto throw_parsing_error(
@@ -55,21 +189,7 @@ namespace cctt
         char const* reason
     ) -> void
     {
-        auto msg = fmt::format(
-            STYLE_LOCATION "{}:{}" STYLE_NORMAL " "
-            "\"" STYLE_SOURCE "{}" STYLE_NORMAL "\" and "
-            STYLE_LOCATION "{}:{}" STYLE_NORMAL " "
-            "\"" STYLE_SOURCE "{}" STYLE_NORMAL "\": "
-            "{}"
-            , loc0.line
-            , loc0.column
-            , util::quote_without_delimiters({tk0->first, tk0->last})
-            , loc1.line
-            , loc1.column
-            , util::quote_without_delimiters({tk1->first, tk1->last})
-            , reason
-        );
-        throw Parsing_Error{msg};
+        throw Parsing_Error{format_scanning_error2(loc0, tk0->first, tk0->last, loc1, tk1->first, tk1->last, reason)};
     }
 
     [[noreturn]] auto throw_parsing_error_of_missing_pair(
@@ -78,11 +198,7 @@ namespace cctt
         char const* missing_pair
     ) -> void
     {
-        auto reason = fmt::format(
-            "missing paired \"" STYLE_SOURCE "{}" STYLE_NORMAL "\"."
-            , util::quote_without_delimiters(missing_pair)
-        );
-        throw_parsing_error(loc, pair, reason.data());
+        throw_scanning_error_of_missing_pair(loc, pair->first, pair->last, missing_pair);
     }
 
     [[noreturn]] auto throw_parsing_error_of_unpaired_pair(
@@ -1,6 +1,10 @@
 #pragma once
 #include "token-tree.hpp"
 #include <stdexcept>
+#include <string>
+#include <vector>
+#include <cstddef>      // for std::size_t
+#include <cstdint>
 
 namespace cctt
 {
@@ -9,8 +13,107 @@ namespace cctt
         using runtime_error::runtime_error;
     };
 
+    enum struct Token_Tree_Error_Kind: std::uint8_t
+    {
+        none,
+
+        // scanning errors
+        unknown_character,
+        incomplete_raw_string,
+        invalid_raw_string_delimiter,
+        unterminated_literal,
+        unterminated_comment,
+        unterminated_raw_string,
+
+        // parsing errors
+        missing_closing_pair,
+        missing_open_pair,
+        unpaired_pair,
+    };
+
+    // A compact record of why a Token_Tree could not be built.
+    // Nothing is formatted until message() is called.
+    struct Token_Tree_Error final
+    {
+        struct Site final
+        {
+            // Index of the offending token.
+            // For scanning errors, it is the index that the token would have had.
+            std::size_t token;
+
+            // Offsets of the offending characters in source.
+            std::size_t first;
+            std::size_t last;
+        };
+
+        Token_Tree_Error_Kind kind{};
+        char const* source{};
+        Site at{};
+
+        // For unpaired_pair only: at is the open pair, and other is the closing pair.
+        Site other{};
+
+        explicit operator bool () const { return kind != Token_Tree_Error_Kind::none; }
+
+        // Same message as that of the Parsing_Error thrown by Token_Tree's constructor.
+        auto message() const -> std::string;
+    };
+
+    // A bounded list of errors, collected by Token_Tree::build_with_recovery().
+    struct Token_Tree_Diagnostics final
+    {
+        Token_Tree_Diagnostics(std::size_t max_errors=100): max_errors{max_errors} {}
+
+        // In the order they are found; scanning errors come before parsing errors.
+        std::vector<Token_Tree_Error> errors;
+
+        // Errors found after max_errors are only counted here.
+        std::size_t dropped{};
+
+        std::size_t max_errors;
+
+        auto add(Token_Tree_Error const& e) -> void
+        {
+            if (errors.size() < max_errors) errors.emplace_back(e);
+            else dropped++;
+        }
+
+        // Keeps the memory of errors.
+        auto clear() -> void
+        {
+            errors.clear();
+            dropped = 0;
+        }
+    };
+
     // scanning error: Errors about characters.
     // parsing  error: Errors about tokens.
+    //
+    // format_*() return the message that the corresponding throw_*() throws.
+
+    auto format_scanning_error(
+        Source_Location loc,
+        char const* first,
+        char const* last,
+        char const* reason
+    ) -> std::string;
+
+    auto format_scanning_error_of_missing_pair(
+        Source_Location loc,
+        char const* first,
+        char const* last,
+        char const* missing_pair
+    ) -> std::string;
+
+    auto format_scanning_error2(
+        Source_Location loc0,
+        char const* first0,
+        char const* last0,
+        Source_Location loc1,
+        char const* first1,
+        char const* last1,
+        char const* reason
+    ) -> std::string;
 
     [[noreturn]] auto throw_scanning_error(
         Source_Location loc,
@@ -0,0 +1,122 @@
+#include "mapped.hpp"
+#include "../util/hash.hpp"
+#include <stdexcept>
+#include <cstring>
+
+namespace cctt
+{
+    namespace
+    {
+        auto align8(std::uint64_t x) -> std::uint64_t
+        {
+            return (x + 7) / 8 * 8;
+        }
+
+        auto malformed() -> std::runtime_error
+        {
+            return std::runtime_error{"Malformed token tree file."};
+        }
+
+        // Returns the offset of the array from base.
+        // Assumes: out.size() - base is a multiple of 8.
+        template <class Get>
+        auto append_u32s(std::string& out, std::size_t base, Token const* first, Token const* last, Get get) -> std::uint64_t
+        {
+            auto offset = out.size() - base;
+            for (auto tk=first; tk <= last; tk++) {
+                auto x = get(*tk);
+                out.append(reinterpret_cast<char const*>(&x), sizeof(x));
+            }
+            out.resize(base + align8(out.size() - base));
+            return offset;
+        }
+    }
+
+    auto save_mapped_token_tree(Token_Tree const& tt, std::string& out) -> void
+    {
+        auto source = tt.source();
+        auto source_size = std::size_t(tt.end()->last - source);
+        if (source_size >= Mapped_Tree_Header::none) throw std::length_error{"Source is too large to be saved."};
+
+        auto token_count = std::size_t(tt.end() - tt.begin()) + 1;
+
+        // The header is written at last, when the offsets are known.
+        auto base = out.size();
+        out.resize(base + align8(sizeof(Mapped_Tree_Header)));
+
+        Mapped_Tree_Header header{};
+        header.magic = Mapped_Tree_Header::current_magic;
+        header.version = Mapped_Tree_Header::current_version;
+        header.token_count = token_count;
+        header.source_size = source_size;
+        header.source_hash = util::hash64(source, source_size);
+
+        auto first = tt.begin();
+        auto last = tt.end();
+        auto index_of = [&] (Token const* tk) {
+            return (tk ? std::uint32_t(tk - first) : Mapped_Tree_Header::none);
+        };
+
+        header.tags    = append_u32s(out, base, first, last, [&] (Token const& tk) { return std::uint32_t(tk.tags.get()); });
+        header.firsts  = append_u32s(out, base, first, last, [&] (Token const& tk) { return std::uint32_t(tk.first - source); });
+        header.lengths = append_u32s(out, base, first, last, [&] (Token const& tk) { return std::uint32_t(tk.last - tk.first); });
+        header.pairs   = append_u32s(out, base, first, last, [&] (Token const& tk) { return index_of(tk.pair); });
+        header.parents = append_u32s(out, base, first, last, [&] (Token const& tk) { return index_of(tk.parent); });
+
+        header.source = out.size() - base;
+        out.append(source, source_size);
+        out.push_back('\0');
+        out.resize(base + align8(out.size() - base));
+
+        header.file_size = out.size() - base;
+        std::memcpy(&out[base], &header, sizeof(header));
+    }
+
+    Mapped_Token_Tree::Mapped_Token_Tree(char const* data, std::size_t size)
+    {
+        if (size < sizeof(Mapped_Tree_Header)) throw malformed();
+
+        Mapped_Tree_Header header;
+        std::memcpy(&header, data, sizeof(header));
+
+        if (header.magic != Mapped_Tree_Header::current_magic) throw malformed();
+        if (header.version != Mapped_Tree_Header::current_version)
+            throw std::runtime_error{"Unsupported token tree file version: " + std::to_string(header.version)};
+        if (header.file_size > size) throw malformed();
+        if (header.token_count == 0 || header.token_count >= Mapped_Tree_Header::none) throw malformed();
+        if (header.source_size >= Mapped_Tree_Header::none) throw malformed();
+
+        auto array_of = [&] (std::uint64_t offset) {
+            auto bytes = header.token_count * sizeof(std::uint32_t);
+            if (offset % 8 != 0 || offset > header.file_size || header.file_size - offset < bytes) throw malformed();
+            return reinterpret_cast<std::uint32_t const*>(data + offset);
+        };
+
+        token_count = std::uint32_t(header.token_count);
+        tags = array_of(header.tags);
+        firsts = array_of(header.firsts);
+        lengths = array_of(header.lengths);
+        pairs = array_of(header.pairs);
+        parents = array_of(header.parents);
+
+        if (header.source > header.file_size || header.file_size - header.source < header.source_size + 1) throw malformed();
+        source_ = data + header.source;
+        source_size_ = std::size_t(header.source_size);
+        source_hash_ = header.source_hash;
+        if (source_[source_size_] != '\0') throw malformed();
+    }
+
+    auto Mapped_Token_Tree::verify() const -> bool
+    {
+        auto is_index = [&] (std::uint32_t i) { return (i == Mapped_Tree_Header::none || i < token_count); };
+
+        for (std::uint32_t i=0; i < token_count; i++) {
+            if (firsts[i] > source_size_ || source_size_ - firsts[i] < lengths[i]) return false;
+            if (!is_index(pairs[i]) || !is_index(parents[i])) return false;
+            if (pairs[i] != Mapped_Tree_Header::none && (pairs[i] == i || pairs[pairs[i]] != i)) return false;
+        }
+
+        return end().is_end();
+    }
+}
+
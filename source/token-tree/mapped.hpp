@@ -0,0 +1,157 @@
+#pragma once
+#include "token-tree.hpp"
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+namespace cctt
+{
+    // A self-contained token tree file, which can be used in place (e.g. mmap'd) without deserializing.
+    // All integers are in host byte order:
+    //
+    //   Mapped_Tree_Header
+    //   u32  tags    [token_count]     // Token_Tag_Set bits
+    //   u32  firsts  [token_count]     // offsets into source
+    //   u32  lengths [token_count]
+    //   u32  pairs   [token_count]     // token indices, or Mapped_Tree_Header::none
+    //   u32  parents [token_count]     // token indices, or Mapped_Tree_Header::none
+    //   char source  [source_size + 1] // zero-terminated
+    //
+    // The last token is the end token. Each array starts at an offset (from the header) that is a multiple of 8.
+    struct Mapped_Tree_Header final
+    {
+        static constexpr std::uint32_t current_magic = 0x4d544343;     // "CCTM"
+        static constexpr std::uint32_t current_version = 1;
+        static constexpr std::uint32_t none = ~std::uint32_t{};
+
+        std::uint32_t magic;
+        std::uint32_t version;
+        std::uint64_t file_size;
+        std::uint64_t token_count;
+        std::uint64_t source_size;
+        std::uint64_t source_hash;      // util::hash64() of source
+
+        std::uint64_t tags;
+        std::uint64_t firsts;
+        std::uint64_t lengths;
+        std::uint64_t pairs;
+        std::uint64_t parents;
+        std::uint64_t source;
+    };
+
+    // Appends tt, including its source, to out.
+    // Throws std::length_error if the source is 4 GiB or larger.
+    auto save_mapped_token_tree(Token_Tree const& tt, std::string& out) -> void;
+
+    struct Mapped_Token_Tree;
+
+    // A Token in a Mapped_Token_Tree, with the same traversal API as Token.
+    // A null Mapped_Token (as returned by pair() of a leaf) is false.
+    struct Mapped_Token final
+    {
+        Mapped_Token() = default;
+        Mapped_Token(Mapped_Token_Tree const* tree, std::uint32_t index): tree{tree}, index{index} {}
+
+        explicit operator bool () const { return (tree != nullptr); }
+
+        auto first() const -> char const*;
+        auto last() const -> char const*;
+        auto tags() const -> Token_Tag_Set;
+
+        auto pair() const -> Mapped_Token;
+        auto parent() const -> Mapped_Token;
+
+        auto is_end() const -> bool { return tags().has_all_of(Token_Tag::end); }
+        auto is_leaf() const -> bool { return !pair(); }
+        auto child() const -> Mapped_Token;
+        auto last_child() const -> Mapped_Token;
+        auto closing_pair() const -> Mapped_Token;
+        auto next() const -> Mapped_Token { return {tree, closing_pair().index + 1}; }
+
+        auto operator ++ () -> Mapped_Token& { index++; return *this; }
+
+        friend auto operator == (Mapped_Token a, Mapped_Token b) -> bool { return (a.tree == b.tree && a.index == b.index); }
+        friend auto operator != (Mapped_Token a, Mapped_Token b) -> bool { return !(a == b); }
+        friend auto operator <  (Mapped_Token a, Mapped_Token b) -> bool { return (a.index < b.index); }
+        friend auto operator <= (Mapped_Token a, Mapped_Token b) -> bool { return (a.index <= b.index); }
+
+        Mapped_Token_Tree const* tree{};
+        std::uint32_t index{};
+    };
+
+    // A view of a file in the format above, e.g. mapped by util::Mapped_File. Nothing is copied.
+    struct Mapped_Token_Tree final
+    {
+        // Checks the header and the bounds of the arrays, in O(1).
+        // Throws std::runtime_error if they are malformed.
+        // data must be aligned to 8 bytes, and outlive the view.
+        Mapped_Token_Tree(char const* data, std::size_t size);
+
+        // Same as Token_Tree::begin() and end().
+        auto begin() const -> Mapped_Token { return {this, 0}; }
+        auto   end() const -> Mapped_Token { return {this, token_count - 1}; }
+
+        auto operator [] (std::size_t i) const -> Mapped_Token { return {this, std::uint32_t(i)}; }
+
+        auto source() const -> char const* { return source_; }
+        auto source_size() const -> std::size_t { return source_size_; }
+        auto source_hash() const -> std::uint64_t { return source_hash_; }
+
+        // Checks every token, in O(n): offsets lie in source, indices are in range, and pairs are mutual.
+        // Call it before traversing a file that may not come from save_mapped_token_tree().
+        auto verify() const -> bool;
+
+    private:
+        friend struct Mapped_Token;
+
+        std::uint32_t token_count;
+        std::uint32_t const* tags;
+        std::uint32_t const* firsts;
+        std::uint32_t const* lengths;
+        std::uint32_t const* pairs;
+        std::uint32_t const* parents;
+        char const* source_;
+        std::size_t source_size_;
+        std::uint64_t source_hash_;
+    };
+
+    inline auto Mapped_Token::first() const -> char const* { return tree->source_ + tree->firsts[index]; }
+    inline auto Mapped_Token::last() const -> char const* { return first() + tree->lengths[index]; }
+    inline auto Mapped_Token::tags() const -> Token_Tag_Set { return Token_Tag_Set::from_bits(tree->tags[index]); }
+
+    inline auto Mapped_Token::pair() const -> Mapped_Token
+    {
+        auto i = tree->pairs[index];
+        if (i == Mapped_Tree_Header::none) return {};
+        return {tree, i};
+    }
+
+    inline auto Mapped_Token::parent() const -> Mapped_Token
+    {
+        auto i = tree->parents[index];
+        if (i == Mapped_Tree_Header::none) return {};
+        return {tree, i};
+    }
+
+    inline auto Mapped_Token::child() const -> Mapped_Token
+    {
+        auto i = tree->pairs[index];
+        if (i == Mapped_Tree_Header::none || i <= index + 1) return {};
+        return {tree, index + 1};
+    }
+
+    inline auto Mapped_Token::last_child() const -> Mapped_Token
+    {
+        auto i = tree->pairs[index];
+        if (i == Mapped_Tree_Header::none || i <= index + 1) return {};
+        return {tree, i};
+    }
+
+    inline auto Mapped_Token::closing_pair() const -> Mapped_Token
+    {
+        auto i = tree->pairs[index];
+        if (i == Mapped_Tree_Header::none || i < index) return *this;
+        return {tree, i};
+    }
+}
+
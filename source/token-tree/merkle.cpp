@@ -0,0 +1,167 @@
+#include "merkle.hpp"
+#include "../util/hash.hpp"
+#include <algorithm>
+#include <unordered_map>
+
+namespace cctt
+{
+    namespace
+    {
+        auto hash_of_leaf(Token const& tk) -> std::uint64_t
+        {
+            return util::hash64(tk.first, std::size_t(tk.last - tk.first), std::uint64_t(tk.tags.get()));
+        }
+
+        auto is_open(Token const* tk) -> bool
+        {
+            return (tk->pair > tk);
+        }
+
+        // The previous sibling of tk, which must not be the first child.
+        auto previous(Token const* tk) -> Token const*
+        {
+            auto p = tk - 1;
+            return (p->pair && p->pair < p ? p->pair : p);
+        }
+
+        struct Differ final
+        {
+            Token_Tree_Hashes const& old_hashes;
+            Token_Tree_Hashes const& new_hashes;
+            std::vector<Token_Tree_Change>& changes;
+
+            auto same(Token const* a, Token const* b) const -> bool
+            {
+                return (old_hashes.of(a) == new_hashes.of(b));
+            }
+
+            // Whether [first, last) is a single block in both trees, with the same brackets.
+            static auto is_same_block(Token const* old_first, Token const* old_last, Token const* new_first, Token const* new_last) -> bool
+            {
+                return (
+                    old_first != old_last && new_first != new_last
+                    && old_first->next() == old_last && new_first->next() == new_last
+                    && is_open(old_first) && is_open(new_first)
+                    && *old_first->first == *new_first->first
+                    && *old_first->pair->first == *new_first->pair->first
+                );
+            }
+
+            // Report [first, last) as changed, or look inside if it is the same block.
+            auto change(Token const* old_first, Token const* old_last, Token const* new_first, Token const* new_last) -> void
+            {
+                if (is_same_block(old_first, old_last, new_first, new_last)) {
+                    diff(old_first + 1, old_first->pair, new_first + 1, new_first->pair);
+                } else {
+                    changes.push_back({old_first, old_last, new_first, new_last});
+                }
+            }
+
+            auto diff(Token const* old_first, Token const* old_last, Token const* new_first, Token const* new_last) -> void
+            {
+                while (old_first != old_last && new_first != new_last && same(old_first, new_first)) {
+                    old_first = old_first->next();
+                    new_first = new_first->next();
+                }
+
+                while (old_first != old_last && new_first != new_last && same(previous(old_last), previous(new_last))) {
+                    old_last = previous(old_last);
+                    new_last = previous(new_last);
+                }
+
+                if (old_first == old_last && new_first == new_last) return;
+
+                if (old_first == old_last || new_first == new_last || is_same_block(old_first, old_last, new_first, new_last))
+                    return change(old_first, old_last, new_first, new_last);
+
+                // Between the first and the last difference, siblings are matched greedily:
+                // after a difference, the next old sibling found again among the new ones (at the nearest place) resynchronizes.
+                std::vector<Token const*> olds;
+                std::vector<Token const*> news;
+                for (auto tk=old_first; tk != old_last; tk = tk->next()) olds.push_back(tk);
+                for (auto tk=new_first; tk != new_last; tk = tk->next()) news.push_back(tk);
+
+                std::unordered_map<std::uint64_t, std::vector<std::size_t>> places;
+                for (std::size_t j=0; j < news.size(); j++)
+                    places[new_hashes.of(news[j])].push_back(j);
+
+                auto old_at = [&] (std::size_t i) { return (i < olds.size() ? olds[i] : old_last); };
+                auto new_at = [&] (std::size_t j) { return (j < news.size() ? news[j] : new_last); };
+
+                std::size_t i = 0;
+                std::size_t j = 0;
+                while (i < olds.size() && j < news.size()) {
+                    if (same(olds[i], news[j])) {
+                        i++;
+                        j++;
+                        continue;
+                    }
+
+                    auto next_i = i;
+                    auto next_j = news.size();
+                    for (; next_i < olds.size(); next_i++) {
+                        auto it = places.find(old_hashes.of(olds[next_i]));
+                        if (it == places.end()) continue;
+
+                        auto place = std::lower_bound(it->second.begin(), it->second.end(), j);
+                        if (place == it->second.end()) continue;
+
+                        next_j = *place;
+                        break;
+                    }
+
+                    change(olds[i], old_at(next_i), news[j], new_at(next_j));
+                    i = next_i;
+                    j = next_j;
+                }
+
+                if (i < olds.size() || j < news.size())
+                    change(old_at(i), old_last, new_at(j), new_last);
+            }
+        };
+    }
+
+    auto Token_Tree_Hashes::reset(Token_Tree const& tt) -> void
+    {
+        auto first = tt.begin();
+        auto last = tt.end();
+
+        base = first;
+        hashes.resize(std::size_t(last - first) + 1);
+        hashes.back() = hash_of_leaf(*last);
+
+        // Backwards, so that children are hashed before their blocks.
+        for (auto tk=last; tk-- != first; ) {
+            auto& hash = hashes[std::size_t(tk - first)];
+
+            if (tk->is_leaf()) {
+                hash = hash_of_leaf(*tk);
+            } else if (is_open(tk)) {
+                scratch.clear();
+                scratch.push_back(hash_of_leaf(*tk));
+                for (auto child=tk + 1; child != tk->pair; child = child->next())
+                    scratch.push_back(hashes[std::size_t(child - first)]);
+                scratch.push_back(hash_of_leaf(*tk->pair));
+
+                hash = util::hash64(scratch.data(), scratch.size() * sizeof(std::uint64_t));
+                hashes[std::size_t(tk->pair - first)] = hash;
+            }
+        }
+
+        scratch.clear();
+        for (auto tk=first; tk != last; tk = tk->next())
+            scratch.push_back(hashes[std::size_t(tk - first)]);
+        root_ = util::hash64(scratch.data(), scratch.size() * sizeof(std::uint64_t));
+    }
+
+    auto diff_token_trees(
+        Token_Tree const& old_tt, Token_Tree_Hashes const& old_hashes,
+        Token_Tree const& new_tt, Token_Tree_Hashes const& new_hashes,
+        std::vector<Token_Tree_Change>& changes
+    ) -> void
+    {
+        if (old_hashes.root() == new_hashes.root()) return;
+        Differ{old_hashes, new_hashes, changes}.diff(old_tt.begin(), old_tt.end(), new_tt.begin(), new_tt.end());
+    }
+}
+
@@ -0,0 +1,55 @@
+#pragma once
+#include "token-tree.hpp"
+#include <vector>
+#include <cstdint>
+
+namespace cctt
+{
+    // A hash of each token, where the hash of a block (either of its pair) covers all the tokens in it, bottom-up.
+    // Hashes cover the text and tags of tokens, but not the whitespace, comments or directives between them.
+    //
+    // Thus, equal hashes mean equal blocks (barring 64-bit collisions), wherever they are in the source.
+    struct Token_Tree_Hashes final
+    {
+        Token_Tree_Hashes() = default;
+        explicit Token_Tree_Hashes(Token_Tree const& tt) { reset(tt); }
+
+        // Hash the tokens of tt, reusing the memory of the hashes.
+        auto reset(Token_Tree const& tt) -> void;
+
+        // tk must be a token of the tree given to reset().
+        auto of(Token const* tk) const -> std::uint64_t { return hashes[std::size_t(tk - base)]; }
+
+        // The hash of the whole tree.
+        auto root() const -> std::uint64_t { return root_; }
+
+    private:
+        Token const* base{};
+        std::vector<std::uint64_t> hashes;      // indexed like the tokens
+        std::uint64_t root_{};
+
+        std::vector<std::uint64_t> scratch;
+    };
+
+    // Sibling tokens [old_first, old_last) of the old tree were replaced by [new_first, new_last) of the new tree.
+    // Either range may be empty, for an insertion or a removal.
+    struct Token_Tree_Change final
+    {
+        Token const* old_first;
+        Token const* old_last;
+        Token const* new_first;
+        Token const* new_last;
+    };
+
+    // Find the changes from the old tree to the new one, appended to changes in source order.
+    //
+    // Blocks with equal hashes are skipped without looking inside; thus, the cost is about the size of the changes,
+    // plus the siblings between them. Siblings are matched by their hashes, greedily rather than minimally.
+    // A block that changed inside, but not its brackets, is looked into rather than reported as a whole.
+    auto diff_token_trees(
+        Token_Tree const& old_tt, Token_Tree_Hashes const& old_hashes,
+        Token_Tree const& new_tt, Token_Tree_Hashes const& new_hashes,
+        std::vector<Token_Tree_Change>& changes
+    ) -> void;
+}
+
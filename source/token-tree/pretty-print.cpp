@@ -1,8 +1,11 @@
 #include "pretty-print.hpp"
 #include "../util/string.hpp"
 #include <fmt/format.hpp>
-#include <iostream>
+#include <algorithm>
 #include <deque>
+#include <vector>
+#include <thread>
+#include <system_error>
 
 #include "../util/style.inl"
 
@@ -10,73 +13,283 @@ namespace cctt
 {
     namespace
     {
-        auto pretty_print_token_tree(Token const* first, Token const* last, char const* link) -> void
+        // Output is accumulated in memory and written to the stream in large chunks.
+        constexpr auto flush_threshold = std::size_t(1) << 20;
+
+        // The children of a block, i.e. first[-1] is the open pair, and last is the closing pair.
+        struct Block
         {
-            struct Block
-            {
-                Token const* first;
-                Token const* last;
-                std::string link;
-
-                Block(Token const* first, Token const* last, char const* link)
-                    : first{first}
-                    , last{last}
-                {
-                    this->link = fmt::format(
-                        STYLE_LINK "{}" STYLE_NORMAL
-                        , link
-                    );
-                }
+            Token const* first;
+            Token const* last;
+        };
+
+        template <std::size_t len>
+        auto write(fmt::memory_buffer& out, char const (&text)[len]) -> void
+        {
+            out.append(text, text + len - 1);
+        }
+
+        auto write(fmt::memory_buffer& out, Token const* tk) -> void
+        {
+            out.append(tk->first, tk->last);
+        }
+
+        auto write_link(fmt::memory_buffer& out, Token const* base, Token const* open) -> void
+        {
+            if (auto first = open->child()) {
+                write(out, STYLE_LINK);
+                write(out, open);
+                fmt::format_to(out, "{:d}", first - base);
+                write(out, open->pair);
+                write(out, STYLE_NORMAL);
+            } else {
+                write(out, STYLE_BLOCK);
+                write(out, open);
+                write(out, open->pair);
+                write(out, STYLE_NORMAL);
+            }
+        }
+
+        auto flush(fmt::memory_buffer& out, std::ostream& os) -> void
+        {
+            os.write(out.data(), out.size());
+            out.resize(0);
+        }
 
-                Block(Token const* base, Token const* tk)
-                    : first{tk->child()}
-                    , last{tk->last_child()}
-                {
-                    if (first == nullptr) {
-                        link = fmt::format(
-                            STYLE_BLOCK "{}{}" STYLE_NORMAL
-                            , std::string{tk->first, tk->last}
-                            , std::string{tk->pair->first, tk->pair->last}
-                        );
-                    } else {
-                        link = fmt::format(
-                            STYLE_LINK "{}{:d}{}" STYLE_NORMAL
-                            , std::string{tk->first, tk->last}
-                            , first - base
-                            , std::string{tk->pair->first, tk->pair->last}
-                        );
-                    }
+        // Write the line of a block, and report each of its non-empty child blocks.
+        //
+        // The whole tree has no open pair, thus is linked by link.
+        // For other blocks, link is nullptr.
+        template <class Report_Child>
+        auto write_block(
+            fmt::memory_buffer& out,
+            Token const* base,
+            Block block,
+            char const* link,
+            Report_Child&& report_child
+        ) -> void
+        {
+            if (link) {
+                write(out, STYLE_LINK);
+                out.append(link, link + std::char_traits<char>::length(link));
+                write(out, STYLE_NORMAL);
+            } else {
+                write_link(out, base, block.first - 1);
+            }
+            write(out, ":");
+
+            for (auto p=block.first; p < block.last; p=p->next()) {
+                out.push_back(' ');
+                if (p->is_leaf()) {
+                    util::append_oneline(out, p->first, p->last);
+                } else {
+                    write_link(out, base, p);
+                    if (auto child = p->child())
+                        report_child(Block{child, p->last_child()});
                 }
-            };
+            }
+
+            write(out, "\n");
+        }
+
+        // The following print the root block and its descendants.
+        // root_link is nullptr if the root is not the whole tree.
+
+        auto pretty_print_token_tree(Token const* base, Block root, char const* root_link, std::ostream& os) -> void
+        {
+            fmt::memory_buffer out;
+            out.reserve(flush_threshold);
 
             std::deque<Block> blocks;
-            blocks.emplace_back(first, last, link);
+            blocks.push_back(root);
 
-            while (!blocks.empty()) {
-                auto block = std::move(blocks.front());
+            for (auto link = root_link; !blocks.empty(); link = nullptr) {
+                auto block = blocks.front();
                 blocks.pop_front();
 
-                std::cout << block.link << ":";
+                write_block(out, base, block, link, [&] (Block child) { blocks.push_back(child); });
+
+                if (out.size() >= flush_threshold)
+                    flush(out, os);
+            }
+
+            flush(out, os);
+        }
+
+        auto pretty_print_token_tree_parallel(Token const* base, Block root, char const* root_link, unsigned jobs, std::ostream& os) -> void
+        {
+            // Each block's line only depends on the block itself (and base),
+            // so collect all blocks in BFS order, and format contiguous partitions concurrently.
+            //
+            // The weight of a block is estimated as the number of its children, plus one for the line itself.
+            struct Weighted_Block
+            {
+                Block block;
+                std::size_t weight;
+            };
+
+            std::vector<Weighted_Block> blocks;
+            blocks.push_back({root, 0});
+
+            auto total_weight = std::size_t(0);
+            for (std::size_t i=0; i < blocks.size(); i++) {
+                auto block = blocks[i].block;
+                auto weight = std::size_t(1);
 
                 for (auto p=block.first; p < block.last; p=p->next()) {
-                    if (p->is_leaf()) {
-                        std::cout << " " << util::format_to_oneline({p->first, p->last});
-                    } else {
-                        blocks.emplace_back(first, p);
-                        std::cout << " " << blocks.back().link;
-                        if (blocks.back().first == nullptr)
-                            blocks.pop_back();
-                    }
+                    weight++;
+                    if (auto child = p->child())
+                        blocks.push_back({{child, p->last_child()}, 0});
                 }
 
-                std::cout << "\n";
+                blocks[i].weight = weight;
+                total_weight += weight;
+            }
+
+            if (jobs > blocks.size()) jobs = unsigned(blocks.size());
+
+            // Partition i is [bounds[i], bounds[i+1]).
+            std::vector<std::size_t> bounds;
+            bounds.reserve(jobs + 1);
+            bounds.push_back(0);
+
+            auto weight = std::size_t(0);
+            for (std::size_t i=0; i < blocks.size(); i++) {
+                weight += blocks[i].weight;
+                if (bounds.size() < jobs && weight * jobs >= total_weight * bounds.size())
+                    bounds.push_back(i + 1);
+            }
+            bounds.push_back(blocks.size());
+
+            auto partitions = bounds.size() - 1;
+            std::vector<fmt::memory_buffer> outs(partitions);
+
+            auto format_partition = [&] (std::size_t i) {
+                for (auto j=bounds[i]; j < bounds[i+1]; j++)
+                    write_block(outs[i], base, blocks[j].block, (j == 0 ? root_link : nullptr), [] (Block) {});
+            };
+
+            // Partitions whose threads cannot be started are formatted on this thread.
+            std::vector<std::thread> threads;
+            threads.reserve(partitions);
+            try {
+                for (std::size_t i=1; i < partitions; i++)
+                    threads.emplace_back(format_partition, i);
+            }
+            catch (std::system_error const&) {}
+
+            try {
+                format_partition(0);
+                for (auto i=threads.size() + 1; i < partitions; i++)
+                    format_partition(i);
+            }
+            catch (...) {
+                for (auto& t: threads) t.join();
+                throw;
+            }
+
+            for (std::size_t i=0; i < partitions; i++) {
+                if (i > 0 && i <= threads.size()) threads[i - 1].join();
+                flush(outs[i], os);
+            }
+        }
+
+        auto pretty_print_token_tree_nested(Token const* base, Block root, char const* root_link, std::ostream& os) -> void
+        {
+            constexpr auto indent_width = 2;
+            constexpr auto estimated_depth = 64;
+
+            // A block being visited, and where to look for its next child block.
+            struct Frame
+            {
+                Block block;
+                Token const* next;
+            };
+
+            fmt::memory_buffer out;
+            out.reserve(flush_threshold);
+
+            std::vector<Frame> frames;
+            frames.reserve(estimated_depth);
+
+            auto visit = [&] (Block block) {
+                out.resize(out.size() + frames.size() * indent_width);
+                std::fill(out.end() - frames.size() * indent_width, out.end(), ' ');
+
+                auto link = (frames.empty() ? root_link : nullptr);
+                write_block(out, base, block, link, [] (Block) {});
+                frames.push_back({block, block.first});
+
+                if (out.size() >= flush_threshold)
+                    flush(out, os);
+            };
+
+            visit(root);
+
+            while (!frames.empty()) {
+                auto& top = frames.back();
+
+                auto p = top.next;
+                while (p < top.block.last && p->child() == nullptr)
+                    p = p->next();
+
+                if (p < top.block.last) {
+                    top.next = p->next();
+                    visit({p->child(), p->last_child()});
+                } else {
+                    frames.pop_back();
+                }
             }
+
+            flush(out, os);
+        }
+    }
+
+    auto pretty_print_token_tree(Token const* first, Token const* last, std::ostream& out) -> void
+    {
+        pretty_print_token_tree(first, {first, last}, "*0*", out);
+    }
+
+    auto pretty_print_token_tree_parallel(Token const* first, Token const* last, unsigned jobs, std::ostream& out) -> void
+    {
+        pretty_print_token_subtree_parallel(first, nullptr, last, jobs, out);
+    }
+
+    auto pretty_print_token_tree_nested(Token const* first, Token const* last, std::ostream& out) -> void
+    {
+        pretty_print_token_tree_nested(first, {first, last}, "*0*", out);
+    }
+
+    auto pretty_print_token_subtree(Token const* base, Token const* open, Token const* last, std::ostream& out) -> void
+    {
+        if (open == nullptr) {
+            pretty_print_token_tree(base, {base, last}, "*0*", out);
+        } else if (auto child = open->child()) {
+            pretty_print_token_tree(base, {child, open->last_child()}, nullptr, out);
         }
     }
 
-    auto pretty_print_token_tree(Token const* first, Token const* last) -> void
+    auto pretty_print_token_subtree_parallel(Token const* base, Token const* open, Token const* last, unsigned jobs, std::ostream& out) -> void
     {
-        pretty_print_token_tree(first, last, "*0*");
+        // More threads than hardware threads would only add overhead.
+        auto hardware_jobs = std::max(1u, std::thread::hardware_concurrency());
+        if (jobs == 0 || jobs > hardware_jobs) jobs = hardware_jobs;
+        if (jobs <= 1) return pretty_print_token_subtree(base, open, last, out);
+
+        if (open == nullptr) {
+            pretty_print_token_tree_parallel(base, {base, last}, "*0*", jobs, out);
+        } else if (auto child = open->child()) {
+            pretty_print_token_tree_parallel(base, {child, open->last_child()}, nullptr, jobs, out);
+        }
+    }
+
+    auto pretty_print_token_subtree_nested(Token const* base, Token const* open, Token const* last, std::ostream& out) -> void
+    {
+        if (open == nullptr) {
+            pretty_print_token_tree_nested(base, {base, last}, "*0*", out);
+        } else if (auto child = open->child()) {
+            pretty_print_token_tree_nested(base, {child, open->last_child()}, nullptr, out);
+        }
     }
 }
 
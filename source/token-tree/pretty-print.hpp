@@ -1,8 +1,26 @@
 #pragma once
 #include "token.hpp"
+#include <iostream>
 
 namespace cctt
 {
-    auto pretty_print_token_tree(Token const* first, Token const* last) -> void;
+    auto pretty_print_token_tree(Token const* first, Token const* last, std::ostream& out=std::cout) -> void;
+
+    // Same output as above, but blocks are formatted by multiple threads.
+    // jobs == 0 means as many threads as there are hardware threads, which also bound larger jobs.
+    auto pretty_print_token_tree_parallel(Token const* first, Token const* last, unsigned jobs, std::ostream& out=std::cout) -> void;
+
+    // Same lines as above, but in depth-first order, each indented by its depth.
+    // Each block is written as soon as it is reached, thus memory usage is bounded by the depth of the tree.
+    auto pretty_print_token_tree_nested(Token const* first, Token const* last, std::ostream& out=std::cout) -> void;
+
+    // Print only the block opened by `open` and its descendants, as they would appear
+    // in the output of printing the whole tree [base, last), e.g. with the same link numbers.
+    //
+    // If open is nullptr, the whole tree is printed.
+    // Nothing is printed if the block is empty.
+    auto pretty_print_token_subtree(Token const* base, Token const* open, Token const* last, std::ostream& out=std::cout) -> void;
+    auto pretty_print_token_subtree_parallel(Token const* base, Token const* open, Token const* last, unsigned jobs, std::ostream& out=std::cout) -> void;
+    auto pretty_print_token_subtree_nested(Token const* base, Token const* open, Token const* last, std::ostream& out=std::cout) -> void;
 }
 
@@ -0,0 +1,125 @@
+#include "region.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <cstring>
+#include <cctype>
+#include <cstdlib>
+
+namespace cctt
+{
+    namespace
+    {
+        auto depth_of(Token const* tk) -> std::size_t
+        {
+            std::size_t depth{};
+            for (auto p=tk->parent; p; p=p->parent) depth++;
+            return depth;
+        }
+
+        // Returns the innermost open pair that encloses both a and b, or nullptr.
+        auto common_parent_of(Token const* a, Token const* b) -> Token const*
+        {
+            a = a->parent;
+            b = b->parent;
+
+            auto depth_a = (a ? depth_of(a) + 1 : 0);
+            auto depth_b = (b ? depth_of(b) + 1 : 0);
+            for (; depth_a > depth_b; depth_a--) a = a->parent;
+            for (; depth_b > depth_a; depth_b--) b = b->parent;
+
+            while (a != b) {
+                a = a->parent;
+                b = b->parent;
+            }
+
+            return a;
+        }
+
+        // Is tk inside the block opened by open? (open == nullptr means the whole tree.)
+        auto is_inside(Token const* tk, Token const* open) -> bool
+        {
+            if (open == nullptr) return true;
+            return (open < tk && tk < open->pair);
+        }
+
+        auto invalid_link(char const* first, char const* last) -> std::runtime_error
+        {
+            return std::runtime_error{"No such block: " + std::string{first, last}};
+        }
+
+        // Parse a single link in [first, last).
+        auto find_block_by_link(Token_Tree const& tt, char const* first, char const* last) -> Token const*
+        {
+            auto p = first;
+            if (p < last && !std::isdigit(static_cast<unsigned char>(*p))) p++;
+
+            auto digits = p;
+            while (p < last && std::isdigit(static_cast<unsigned char>(*p))) p++;
+            if (p == digits) throw invalid_link(first, last);
+
+            auto index = std::strtoull(std::string{digits, p}.data(), nullptr, 10);
+            auto open_text = std::string{first, digits};
+            auto closing_text = std::string{p, last};
+            if (closing_text.size() > 1) throw invalid_link(first, last);
+
+            if (open_text == "*" && closing_text == "*") {
+                if (index != 0) throw invalid_link(first, last);
+                return nullptr;
+            }
+
+            auto size = std::size_t(tt.end() - tt.begin());
+            if (index == 0 || index > size) throw invalid_link(first, last);
+
+            auto open = tt.begin() + index - 1;
+            if (open->child() != open + 1) throw invalid_link(first, last);
+            if (!open_text.empty() && open_text != std::string{open->first, open->last}) throw invalid_link(first, last);
+            if (!closing_text.empty() && closing_text != std::string{open->pair->first, open->pair->last}) throw invalid_link(first, last);
+
+            return open;
+        }
+    }
+
+    auto find_block_by_lines(Token_Tree const& tt, std::size_t first_line, std::size_t last_line) -> Token const*
+    {
+        if (last_line < first_line) std::swap(first_line, last_line);
+
+        auto from = tt.start_of_line(first_line);
+        auto to = tt.start_of_line(last_line + 1);
+
+        // Tokens are sorted by their positions in source.
+        auto by_position = [] (Token const& tk, char const* at) { return (tk.first < at); };
+        auto first = std::lower_bound(tt.begin(), tt.end(), from, by_position);
+        auto last = std::lower_bound(first, tt.end(), to, by_position);
+
+        if (first == tt.end()) {
+            auto range = std::to_string(first_line);
+            if (last_line != first_line) range += ":" + std::to_string(last_line);
+            throw std::runtime_error{"No such lines: " + range};
+        }
+        if (first == last) last++;
+
+        return common_parent_of(first, last - 1);
+    }
+
+    auto find_block_by_link(Token_Tree const& tt, char const* path) -> Token const*
+    {
+        auto open = (Token const*) nullptr;
+
+        for (auto first = path; *first; ) {
+            auto last = std::strchr(first, '/');
+            if (last == nullptr) last = first + std::strlen(first);
+
+            if (last > first) {
+                auto block = find_block_by_link(tt, first, last);
+                if (block && !is_inside(block, open)) throw invalid_link(first, last);
+                open = block;
+            }
+
+            first = (*last ? last + 1 : last);
+        }
+
+        return open;
+    }
+}
+
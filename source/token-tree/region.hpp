@@ -0,0 +1,25 @@
+#pragma once
+#include "token-tree.hpp"
+#include <cstddef>
+
+namespace cctt
+{
+    // The following return the open pair of a block, or nullptr for the whole tree.
+    // The result can be passed to pretty_print_token_subtree().
+
+    // Find the innermost block that encloses all tokens on lines [first_line, last_line] (1-based, inclusive).
+    // If there is no token on these lines, the block enclosing the next token is found.
+    //
+    // Throws std::runtime_error if there is no token on or after first_line.
+    auto find_block_by_lines(Token_Tree const& tt, std::size_t first_line, std::size_t last_line) -> Token const*;
+
+    // Find a block by its link, as printed by pretty_print_token_tree(), e.g. "{123}", "(42)" or just "123".
+    // "*0*" means the whole tree.
+    //
+    // A path of links separated by "/" (e.g. "*0*/{5}/{48}") is also accepted.
+    // Each link must be a descendant of the previous one, and the last link is found.
+    //
+    // Throws std::runtime_error if there is no such block.
+    auto find_block_by_link(Token_Tree const& tt, char const* path) -> Token const*;
+}
+
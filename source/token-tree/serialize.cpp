@@ -0,0 +1,57 @@
+#include "serialize.hpp"
+#include "../util/hash.hpp"
+#include <stdexcept>
+#include <cstring>
+#include <cstddef>      // for offsetof
+
+namespace cctt
+{
+    namespace
+    {
+        template <class Record>
+        auto append(std::string& out, Record const& x) -> void
+        {
+            out.append(reinterpret_cast<char const*>(&x), sizeof(x));
+        }
+    }
+
+    auto save_token_tree(Token_Tree const& tt, std::uint64_t source_hash, std::string& out) -> void
+    {
+        auto source = tt.source();
+        auto source_size = std::size_t(tt.end()->last - source);
+        if (source_size >= Serialized_Token::none) throw std::length_error{"Source is too large to be serialized."};
+
+        auto base = tt.begin();
+        auto index_of = [&] (Token const* tk) {
+            return (tk ? std::uint32_t(tk - base) : Serialized_Token::none);
+        };
+
+        auto token_count = std::size_t(tt.end() - base) + 1;
+        out.reserve(out.size() + sizeof(Serialized_Tree_Header) + token_count * sizeof(Serialized_Token));
+
+        auto header_offset = out.size();
+        append(out, Serialized_Tree_Header{
+            Serialized_Tree_Header::current_magic,
+            Serialized_Tree_Header::current_version,
+            source_size,
+            source_hash,
+            token_count,
+            0,
+        });
+
+        for (auto tk=base; tk <= tt.end(); tk++) {
+            append(out, Serialized_Token{
+                std::uint32_t(tk->first - source),
+                std::uint32_t(tk->last - source),
+                std::uint32_t(tk->tags.get()),
+                index_of(tk->pair),
+                index_of(tk->parent),
+            });
+        }
+
+        auto tokens_offset = header_offset + sizeof(Serialized_Tree_Header);
+        auto tokens_hash = util::hash64(out.data() + tokens_offset, out.size() - tokens_offset);
+        std::memcpy(&out[header_offset + offsetof(Serialized_Tree_Header, tokens_hash)], &tokens_hash, sizeof(tokens_hash));
+    }
+}
+
@@ -0,0 +1,44 @@
+#pragma once
+#include "token-tree.hpp"
+#include <string>
+#include <cstdint>
+
+namespace cctt
+{
+    // A relocatable copy of a Token_Tree, in host byte order:
+    //
+    //   Serialized_Tree_Header
+    //   Serialized_Token [token_count]     // including the end token
+    //
+    // Pointers are replaced by offsets into source, and pairs and parents by token indices.
+    // Token_Tree::try_load() turns it back into a tree over the same source.
+
+    struct Serialized_Tree_Header final
+    {
+        static constexpr std::uint32_t current_magic = 0x54544343;     // "CCTT"
+        static constexpr std::uint32_t current_version = 1;
+
+        std::uint32_t magic;
+        std::uint32_t version;
+        std::uint64_t source_size;
+        std::uint64_t source_hash;      // util::hash64() of source
+        std::uint64_t token_count;
+        std::uint64_t tokens_hash;      // util::hash64() of the Serialized_Tokens, against corrupted files
+    };
+
+    struct Serialized_Token final
+    {
+        static constexpr std::uint32_t none = ~std::uint32_t{};
+
+        std::uint32_t first;
+        std::uint32_t last;
+        std::uint32_t tags;
+        std::uint32_t pair;             // or none
+        std::uint32_t parent;           // or none
+    };
+
+    // Appends tt to out.
+    // Throws std::length_error if the source is 4 GiB or larger.
+    auto save_token_tree(Token_Tree const& tt, std::uint64_t source_hash, std::string& out) -> void;
+}
+
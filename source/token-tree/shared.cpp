@@ -0,0 +1,171 @@
+#include "shared.hpp"
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace cctt
+{
+    namespace
+    {
+        auto align8(std::uint64_t x) -> std::uint64_t
+        {
+            return (x + 7) & ~std::uint64_t{7};
+        }
+
+        auto malformed(char const* name) -> std::runtime_error
+        {
+            return std::runtime_error{"Malformed shared token trees: " + std::string{name}};
+        }
+
+        auto system_error(char const* what, char const* name) -> std::runtime_error
+        {
+            return std::runtime_error{std::string{what} + " " + name + ": " + std::strerror(errno)};
+        }
+
+        // Closes on destruction.
+        struct File_Descriptor final
+        {
+            File_Descriptor(int fd): fd{fd} {}
+            ~File_Descriptor() { if (fd >= 0) ::close(fd); }
+
+            File_Descriptor(File_Descriptor const&) = delete;
+            auto operator = (File_Descriptor const&) -> File_Descriptor& = delete;
+
+            int fd;
+        };
+    }
+
+    Shared_Trees_Builder::Shared_Trees_Builder()
+        : trees(align8(sizeof(Shared_Trees_Header)), '\0')
+    {}
+
+    auto Shared_Trees_Builder::add(std::string const& path, Token_Tree const& tt) -> void
+    {
+        Shared_Trees_Entry entry;
+        entry.tree = trees.size();
+        save_mapped_token_tree(tt, trees);
+        entry.tree_size = trees.size() - entry.tree;
+
+        entry.path = paths.size();
+        entry.path_size = path.size();
+        paths += path;
+
+        entries.push_back(entry);
+    }
+
+    auto Shared_Trees_Builder::publish(char const* name) const -> void
+    {
+        auto entries_offset = trees.size();
+        auto paths_offset = entries_offset + entries.size() * sizeof(Shared_Trees_Entry);
+        auto size = paths_offset + paths.size();
+
+        // A new object is created, instead of truncating the old one under the feet of its readers.
+        ::shm_unlink(name);
+        File_Descriptor shm{::shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644)};
+        if (shm.fd < 0) throw system_error("Cannot create shared memory", name);
+
+        if (::ftruncate(shm.fd, off_t(size)) != 0) {
+            ::shm_unlink(name);
+            throw system_error("Cannot resize shared memory", name);
+        }
+
+        auto p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, shm.fd, 0);
+        if (p == MAP_FAILED) {
+            ::shm_unlink(name);
+            throw system_error("Cannot map shared memory", name);
+        }
+        auto data = static_cast<char*>(p);
+
+        auto header_size = align8(sizeof(Shared_Trees_Header));
+        std::memcpy(data + header_size, trees.data() + header_size, trees.size() - header_size);
+
+        for (std::size_t i=0; i < entries.size(); i++) {
+            auto entry = entries[i];
+            entry.path += paths_offset;
+            std::memcpy(data + entries_offset + i * sizeof(entry), &entry, sizeof(entry));
+        }
+        std::memcpy(data + paths_offset, paths.data(), paths.size());
+
+        Shared_Trees_Header header{};
+        header.version = Shared_Trees_Header::current_version;
+        header.size = size;
+        header.tree_count = entries.size();
+        header.entries = entries_offset;
+        std::memcpy(data, &header, sizeof(header));
+
+        std::atomic_thread_fence(std::memory_order_release);
+        auto magic = Shared_Trees_Header::current_magic;
+        std::memcpy(data, &magic, sizeof(magic));
+
+        ::munmap(p, size);
+    }
+
+    auto unpublish_token_trees(char const* name) -> bool
+    {
+        return (::shm_unlink(name) == 0);
+    }
+
+    Shared_Token_Trees::Shared_Token_Trees(char const* name)
+    {
+        File_Descriptor shm{::shm_open(name, O_RDONLY | O_CLOEXEC, 0)};
+        if (shm.fd < 0) throw system_error("Cannot open shared memory", name);
+
+        struct stat st;
+        if (::fstat(shm.fd, &st) != 0) throw system_error("Cannot open shared memory", name);
+        if (std::size_t(st.st_size) < sizeof(Shared_Trees_Header)) throw malformed(name);
+
+        auto p = ::mmap(nullptr, std::size_t(st.st_size), PROT_READ, MAP_SHARED, shm.fd, 0);
+        if (p == MAP_FAILED) throw system_error("Cannot map shared memory", name);
+        data = static_cast<char const*>(p);
+        data_size = std::size_t(st.st_size);
+
+        try {
+            Shared_Trees_Header header;
+            std::memcpy(&header, data, sizeof(header));
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if (header.magic != Shared_Trees_Header::current_magic) throw malformed(name);
+            if (header.version != Shared_Trees_Header::current_version)
+                throw std::runtime_error{"Unsupported shared token trees version: " + std::to_string(header.version)};
+            if (header.size != data_size || header.entries > data_size) throw malformed(name);
+            if ((data_size - header.entries) / sizeof(Shared_Trees_Entry) < header.tree_count) throw malformed(name);
+
+            paths.reserve(std::size_t(header.tree_count));
+            trees.reserve(std::size_t(header.tree_count));
+
+            for (std::uint64_t i=0; i < header.tree_count; i++) {
+                Shared_Trees_Entry entry;
+                std::memcpy(&entry, data + header.entries + i * sizeof(entry), sizeof(entry));
+
+                if (entry.path > data_size || data_size - entry.path < entry.path_size) throw malformed(name);
+                if (entry.tree % 8 != 0 || entry.tree > header.entries || header.entries - entry.tree < entry.tree_size) throw malformed(name);
+
+                paths.emplace_back(data + entry.path, std::size_t(entry.path_size));
+                trees.emplace_back(data + entry.tree, std::size_t(entry.tree_size));
+            }
+        }
+        catch (...) {
+            ::munmap(p, data_size);
+            throw;
+        }
+    }
+
+    Shared_Token_Trees::~Shared_Token_Trees()
+    {
+        ::munmap(const_cast<char*>(data), data_size);
+    }
+
+    auto Shared_Token_Trees::find(std::string const& path) const -> Mapped_Token_Tree const*
+    {
+        auto it = std::find(paths.begin(), paths.end(), path);
+        if (it == paths.end()) return nullptr;
+        return &trees[std::size_t(it - paths.begin())];
+    }
+}
+
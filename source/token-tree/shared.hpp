@@ -0,0 +1,86 @@
+#pragma once
+#include "mapped.hpp"
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace cctt
+{
+    // A POSIX shared memory object holding token trees of many files, for other processes to use in place.
+    // All offsets are from the start of the object, so that it can be mapped at any address:
+    //
+    //   Shared_Trees_Header
+    //   trees   [tree_count]           // in the format of mapped.hpp, each starting at a multiple of 8
+    //   Shared_Trees_Entry entries [tree_count]
+    //   char    paths []               // not zero-terminated
+    struct Shared_Trees_Header final
+    {
+        static constexpr std::uint32_t current_magic = 0x53544343;     // "CCTS"
+        static constexpr std::uint32_t current_version = 1;
+
+        // Written after everything else, so that a half-written object is never taken for a complete one.
+        std::uint32_t magic;
+        std::uint32_t version;
+        std::uint64_t size;
+        std::uint64_t tree_count;
+        std::uint64_t entries;
+    };
+
+    struct Shared_Trees_Entry final
+    {
+        std::uint64_t path;
+        std::uint64_t path_size;
+        std::uint64_t tree;
+        std::uint64_t tree_size;
+    };
+
+    // Collects token trees, then publishes them at once.
+    struct Shared_Trees_Builder final
+    {
+        Shared_Trees_Builder();
+
+        // Copies tt, so that tt can be reused for the next file.
+        // Throws std::length_error if the source is 4 GiB or larger.
+        auto add(std::string const& path, Token_Tree const& tt) -> void;
+
+        // Replaces the shared memory object name (e.g. "/cctt-trees") with the trees added so far.
+        // Processes that have mapped the previous object keep using it until they unmap it.
+        // Throws std::runtime_error if the object cannot be created.
+        auto publish(char const* name) const -> void;
+
+    private:
+        std::string trees;      // the object, up to the trees
+        std::vector<Shared_Trees_Entry> entries;
+        std::string paths;
+    };
+
+    // Removes the shared memory object name. Returns false if it does not exist.
+    auto unpublish_token_trees(char const* name) -> bool;
+
+    // A read-only mapping of a shared memory object published by Shared_Trees_Builder.
+    // Trees are views into the mapping: nothing is parsed or copied.
+    struct Shared_Token_Trees final
+    {
+        // Throws std::runtime_error if the object does not exist, or is malformed.
+        Shared_Token_Trees(char const* name);
+        ~Shared_Token_Trees();
+
+        Shared_Token_Trees(Shared_Token_Trees const&) = delete;
+        auto operator = (Shared_Token_Trees const&) -> Shared_Token_Trees& = delete;
+
+        auto size() const -> std::size_t { return trees.size(); }
+        auto path(std::size_t i) const -> std::string const& { return paths[i]; }
+        auto tree(std::size_t i) const -> Mapped_Token_Tree const& { return trees[i]; }
+
+        // Returns nullptr if no tree has the path as it was given to Shared_Trees_Builder::add().
+        auto find(std::string const& path) const -> Mapped_Token_Tree const*;
+
+    private:
+        char const* data{};
+        std::size_t data_size{};
+        std::vector<std::string> paths;
+        std::vector<Mapped_Token_Tree> trees;
+    };
+}
+
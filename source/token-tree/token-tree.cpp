@@ -1,9 +1,15 @@
 #include "../util/buffer.hpp"
+#include "../util/hash.hpp"
 #include "error.hpp"
 #include "token-tree.hpp"
+#include "serialize.hpp"
 #include <algorithm>
+#include <stdexcept>
+#include <cstdint>
 #include <cstring>
 #include <csignal>
+#include <thread>
+#include <system_error>
 
 namespace cctt
 {
@@ -47,20 +53,85 @@ namespace cctt
 
             struct Start_of_Line_Index final
             {
-                Start_of_Line_Index(char const* source)
-                    : index{build_start_of_line_index(source)}
+                Start_of_Line_Index(util::Arena* arena=nullptr)
+                    : index{arena ? util::Buffer<char const*>{*arena} : util::Buffer<char const*>{}}
+                    , edited{arena ? util::Buffer<char const*>{*arena} : util::Buffer<char const*>{}}
                 {}
 
-                // Assumes: at < index.end()[-1]; (that is, at - source < strlen(source))
+                Start_of_Line_Index(char const* source)
+                {
+                    reset(source);
+                }
+
+                // Reuses the memory of the index.
+                auto reset(char const* source) -> void
+                {
+                    index.reset(count_lines(source) + 1);
+
+                    auto p = index.data();
+                    *p++ = source;
+
+                    if (*source != '\0') {
+                        while (*++source)
+                            if (source[-1] == '\n')
+                                *p++ = source;
+
+                        // sentinel
+                        *p++ = source;
+                    }
+                }
+
+                // Same as reset(source), where source is old_source with removed_size characters at offset
+                // replaced by inserted_size characters. Only the lines of the edit are scanned.
+                auto apply_edit(char const* old_source, char const* source, std::size_t offset, std::size_t removed_size, std::size_t inserted_size) -> void
+                {
+                    auto old_base = reinterpret_cast<std::uintptr_t>(old_source);
+                    auto offset_of = [&] (char const* p) { return std::size_t(reinterpret_cast<std::uintptr_t>(p) - old_base); };
+
+                    // Unless the edit leaves some of the old source after it, the sentinel needs care; scan it all.
+                    if (offset + removed_size >= offset_of(index.end()[-1]))
+                        return reset(source);
+
+                    // Starts of lines up to offset are kept, those after the removed characters are shifted.
+                    auto kept = std::size_t(std::partition_point(index.begin(), index.end(), [&] (char const* p) {
+                        return (offset_of(p) <= offset);
+                    }) - index.begin());
+                    auto shifted = std::size_t(std::partition_point(index.begin() + kept, index.end(), [&] (char const* p) {
+                        return (offset_of(p) <= offset + removed_size);
+                    }) - index.begin());
+
+                    auto inserted = std::size_t(std::count(source + offset, source + offset + inserted_size, '\n'));
+                    auto delta = std::ptrdiff_t(inserted_size) - std::ptrdiff_t(removed_size);
+
+                    edited.reset(kept + inserted + (index.size() - shifted));
+                    auto p = edited.data();
+
+                    for (std::size_t i=0; i < kept; i++)
+                        *p++ = source + offset_of(index[i]);
+
+                    for (auto q=source + offset; q < source + offset + inserted_size; q++)
+                        if (*q == '\n')
+                            *p++ = q + 1;
+
+                    for (auto i=shifted; i < index.size(); i++)
+                        *p++ = source + std::ptrdiff_t(offset_of(index[i])) + delta;
+
+                    std::swap(index, edited);
+                }
+
+                // The end of source counts as on the last line: the sentinel is returned for it.
+                // Assumes: the source is not empty.
                 auto start_of_next_line(char const* at) const -> char const* const&
                 {
-                    return *std::upper_bound(index.begin(), index.end(), at);
+                    return *std::upper_bound(index.begin(), index.end() - 1, at);
                 }
 
                 // Assumes: at >= index[0];
-                // Assumes: at < index.end()[-1]; (that is, at - source < strlen(source))
+                // Assumes: at <= index.end()[-1]; (that is, at - source <= strlen(source))
                 auto source_location_of(char const* at) const -> Source_Location
                 {
+                    if (index.size() == 1) return { 1, std::size_t(at - index[0] + 1) };
+
                     auto& sonl = start_of_next_line(at);
                     auto sol = (&sonl)[-1];
 
@@ -70,28 +141,76 @@ namespace cctt
                     return { line, column };
                 }
 
-            private:
-                util::Buffer<char const*> index;
-
-                static auto build_start_of_line_index(char const* source) -> util::Buffer<char const*>
+                // Same as source_location_of(at(*it)) for each it in [first, last),
+                // but by merging them with the index, as they are sorted.
+                template <class Iterator, class At>
+                auto source_locations_of(Iterator first, Iterator last, At at, Source_Location* out) const -> void
                 {
-                    auto index = util::Buffer<char const*>{count_lines(source) + 1};
+                    if (first == last) return;
 
-                    auto p = index.data();
-                    *p++ = source;
+                    if (index.size() == 1) {
+                        for (; first != last; ++first)
+                            *out++ = source_location_of(at(*first));
+                        return;
+                    }
 
-                    if (*source != '\0') {
-                        while (*++source)
-                            if (source[-1] == '\n')
-                                *p++ = source;
+                    auto sentinel = index.end() - 1;
+                    auto sonl = &start_of_next_line(at(*first));
+                    for (; first != last; ++first) {
+                        auto p = at(*first);
+                        while (sonl != sentinel && *sonl <= p) sonl++;
 
-                        // sentinel
-                        *p++ = source;
+                        auto line = std::size_t(sonl - index.begin());
+                        auto column = std::size_t(p - sonl[-1] + 1);
+                        *out++ = { line, column };
                     }
+                }
 
-                    return index;
+                // Same as above, but [first, last) is split into jobs parts, which are merged in parallel.
+                template <class Iterator, class At>
+                auto source_locations_of_parallel(Iterator first, Iterator last, At at, Source_Location* out, unsigned jobs) const -> void
+                {
+                    constexpr auto least_part_size = std::ptrdiff_t(1) << 16;
+
+                    auto size = last - first;
+                    if (jobs == 0) jobs = std::thread::hardware_concurrency();
+                    if (jobs > size / least_part_size) jobs = unsigned(size / least_part_size);
+                    if (jobs <= 1) return source_locations_of(first, last, at, out);
+
+                    auto part = [&] (unsigned i) {
+                        auto from = size * i / jobs;
+                        auto to = size * (i + 1) / jobs;
+                        source_locations_of(first + from, first + to, at, out + from);
+                    };
+
+                    // Parts whose threads cannot be started are merged on this thread.
+                    std::vector<std::thread> threads;
+                    threads.reserve(jobs - 1);
+                    try {
+                        for (unsigned i=1; i < jobs; i++)
+                            threads.emplace_back(part, i);
+                    }
+                    catch (std::system_error const&) {}
+
+                    part(0);
+                    for (auto i=unsigned(threads.size()) + 1; i < jobs; i++) part(i);
+                    for (auto& t: threads) t.join();
                 }
 
+                // Lines are 1-based. Returns the end of source if line is past the last line.
+                auto start_of_line(std::size_t line) const -> char const*
+                {
+                    if (line == 0) line = 1;
+                    if (line > index.size()) line = index.size();
+                    return index[line - 1];
+                }
+
+            private:
+                util::Buffer<char const*> index;
+
+                // Scratch index of apply_edit().
+                util::Buffer<char const*> edited;
+
                 static auto count_lines(char const* source) -> std::size_t
                 {
                     if (*source == '\0') return 0;
@@ -108,29 +227,307 @@ namespace cctt
 
     struct Token_Tree::Impl final
     {
-        Impl(char const* source)
-            : source{source}
-            , sol_index{source}
+        // An empty tree.
+        // If arena is given, all memory of the tree comes from it.
+        Impl(util::Arena* arena=nullptr)
+            : sol_index{arena}
+            , tokens{Allocator<Token>{arena}}
+            , blocks{Allocator<Token*>{arena}}
+            , parents{Allocator<Token const*>{arena}}
+            , edited{Allocator<Token>{arena}}
+            , includes{Allocator<Include_Directive>{arena}}
         {
-            scan();
-            build_token_pairs();
-            build_token_tree();
+            clear();
         }
 
-        auto begin() const { return tokens.data(); }
-        auto   end() const { return tokens.data() + tokens.size() - 1; }
+        // On failure, error is set and the tokens are left incomplete.
+        //
+        // If diagnostics is given, it never fails:
+        // errors are added to diagnostics, and the scanning or pairing recovers from them.
+        //
+        // All memory is kept for the next reset(), so that no allocation happens
+        // once the capacities are large enough.
+        auto reset(char const* source, Token_Tree_Error& error, Token_Tree_Diagnostics* diagnostics=nullptr) -> void
+        {
+            this->source = source;
+            this->diagnostics = diagnostics;
+            recovered = false;
+            sol_index.reset(source);
+            tokens.clear();
+            includes.clear();
+
+            error = {};
+            error.source = source;
+
+            tokens.reserve(estimate_token_count(source));
+            auto never = [] (char const*) { return false; };
 
+            if (scan(source, tokens, never, error) && build_token_pairs(begin(), end(), error))
+                build_token_tree(begin(), end(), nullptr);
+
+            this->diagnostics = nullptr;
+        }
+
+        // See Token_Tree::try_apply_edit(). On failure, error is set and the tokens are left incomplete.
+        //
+        // The old source may be gone: tokens are only used for their offsets from it.
+        auto apply_edit(char const* source, std::size_t offset, std::size_t removed_size, std::size_t inserted_size, Token_Tree_Error& error) -> void
+        {
+            auto old_source = reinterpret_cast<std::uintptr_t>(this->source);
+            auto offset_of = [&] (char const* p) { return std::size_t(reinterpret_cast<std::uintptr_t>(p) - old_source); };
+
+            auto old_size = offset_of(end()->first);
+            if (offset > old_size || removed_size > old_size - offset) throw std::out_of_range{"The edit is out of the source."};
+
+            // Tokens recovered from errors may not come back from scanning again.
+            // Directives are recorded in order, which rescanning a part would not keep.
+            if (recovered || records_includes) return reset(source, error);
+
+            sol_index.apply_edit(this->source, source, offset, removed_size, inserted_size);
+            this->source = source;
+
+            error = {};
+            error.source = source;
+
+            // Scanning a token reads at most this many characters past its end (e.g. `..x`).
+            constexpr auto max_lookahead = std::size_t(2);
+
+            // Tokens [0, first_changed) read nothing of the edit, and are kept.
+            // Scanning goes on from the end of the last of them.
+            auto first_changed = std::size_t(std::partition_point(tokens.begin(), tokens.end() - 1, [&] (Token const& tk) {
+                return (offset_of(tk.last) + max_lookahead <= offset);
+            }) - tokens.begin());
+
+            auto from = (first_changed == 0 ? source : source + offset_of(tokens[first_changed - 1].last));
+
+            // Scanning is resynchronized at the first new token after the edit that starts where an old token started:
+            // the rest of the source is the same, so are the rest of the tokens.
+            auto delta = std::ptrdiff_t(inserted_size) - std::ptrdiff_t(removed_size);
+            auto first_kept = first_changed;
+            auto resync = [&] (char const* first) {
+                auto at = std::size_t(first - source);
+                if (at < offset + inserted_size) return false;
+
+                auto old_at = std::size_t(std::ptrdiff_t(at) - delta);
+                while (offset_of(tokens[first_kept].first) < old_at) first_kept++;
+                return (offset_of(tokens[first_kept].first) == old_at);
+            };
+
+            edited.clear();
+            if (!scan(from, edited, resync, error)) {
+                error.at.token += first_changed;
+                return;
+            }
+
+            // The innermost block around the rescanned tokens, if any,
+            // is the only one to be paired again, unless it is ambiguous (`<`).
+            auto enclosing = (Token const*) nullptr;
+            if (first_changed != 0) {
+                auto tk = &tokens[first_changed - 1];
+                enclosing = (tk->pair > tk ? tk : tk->parent);
+                while (enclosing && (enclosing->pair < &tokens[first_kept] || source[offset_of(enclosing->first)] == '<'))
+                    enclosing = enclosing->parent;
+            }
+
+            auto enclosing_open = (enclosing ? std::size_t(enclosing - tokens.data()) : 0);
+            auto enclosing_closing = (enclosing ? std::size_t(enclosing->pair - tokens.data()) : 0);
+
+            // Replace tokens [first_changed, first_kept) with the edited ones.
+            auto old_data = reinterpret_cast<std::uintptr_t>(tokens.data());
+            auto removed_count = first_kept - first_changed;
+            auto inserted_count = edited.size();
+
+            if (inserted_count > removed_count) {
+                tokens.insert(tokens.begin() + std::ptrdiff_t(first_kept), edited.begin() + std::ptrdiff_t(removed_count), edited.end());
+                std::copy(edited.begin(), edited.begin() + std::ptrdiff_t(removed_count), tokens.begin() + std::ptrdiff_t(first_changed));
+            } else {
+                std::copy(edited.begin(), edited.end(), tokens.begin() + std::ptrdiff_t(first_changed));
+                tokens.erase(tokens.begin() + std::ptrdiff_t(first_changed + inserted_count), tokens.begin() + std::ptrdiff_t(first_kept));
+            }
+
+            // Pointers of the kept tokens are moved to the new source and the new tokens.
+            auto shift = std::ptrdiff_t(inserted_count) - std::ptrdiff_t(removed_count);
+            auto relink = [&] (Token const* tk) -> Token const* {
+                if (tk == nullptr) return nullptr;
+
+                auto i = std::size_t((reinterpret_cast<std::uintptr_t>(tk) - old_data) / sizeof(Token));
+                if (i < first_changed) return tokens.data() + i;
+                if (i >= first_kept) return tokens.data() + std::ptrdiff_t(i) + shift;
+                return nullptr;     // a replaced token; the enclosing block will be paired again
+            };
+            auto rebase = [&] (Token& tk, std::ptrdiff_t delta) {
+                tk.first = source + std::ptrdiff_t(offset_of(tk.first)) + delta;
+                tk.last = source + std::ptrdiff_t(offset_of(tk.last)) + delta;
+                tk.pair = relink(tk.pair);
+                tk.parent = relink(tk.parent);
+            };
+
+            for (std::size_t i=0; i < first_changed; i++)
+                rebase(tokens[i], 0);
+            for (auto i=first_changed + inserted_count; i < tokens.size(); i++)
+                rebase(tokens[i], delta);
+
+            if (enclosing) {
+                auto open = tokens.data() + enclosing_open;
+                auto closing = tokens.data() + std::ptrdiff_t(enclosing_closing) + shift;
+                for (auto tk=open + 1; tk < closing; tk++)
+                    tk->pair = nullptr;
+
+                // It pairs the same as all the tokens would, unless a bracket inside is left unpaired:
+                // then it may pair with the enclosing block, or be an error.
+                if (build_token_pairs(open + 1, closing, error)) {
+                    build_token_tree(open + 1, closing, open);
+                    return;
+                }
+
+                error = {};
+                error.source = source;
+            }
+
+            for (auto& tk: tokens)
+                tk.pair = nullptr;
+
+            if (build_token_pairs(begin(), end(), error))
+                build_token_tree(begin(), end(), nullptr);
+        }
+
+        // See Token_Tree::try_load().
+        auto load(char const* source, char const* first, char const* last) -> bool
+        {
+            auto size = std::size_t(last - first);
+            if (size < sizeof(Serialized_Tree_Header)) return false;
+
+            Serialized_Tree_Header header;
+            std::memcpy(&header, first, sizeof(header));
+            first += sizeof(header);
+            size -= sizeof(header);
+
+            if (header.magic != Serialized_Tree_Header::current_magic) return false;
+            if (header.version != Serialized_Tree_Header::current_version) return false;
+            if (header.token_count == 0 || header.token_count != size / sizeof(Serialized_Token)) return false;
+            if (size % sizeof(Serialized_Token) != 0) return false;
+
+            auto source_size = std::strlen(source);
+            if (header.source_size != source_size) return false;
+            if (header.tokens_hash != util::hash64(first, size)) return false;
+
+            this->source = source;
+            recovered = false;
+            sol_index.reset(source);
+            tokens.clear();
+            includes.clear();
+            tokens.reserve(header.token_count);
+
+            auto count = std::size_t(header.token_count);
+            auto is_index = [&] (std::uint32_t i) { return (i == Serialized_Token::none || i < count); };
+
+            for (std::size_t i=0; i < count; i++) {
+                Serialized_Token x;
+                std::memcpy(&x, first + i * sizeof(x), sizeof(x));
+                if (x.first > x.last || x.last > source_size) return false;
+                if (!is_index(x.pair) || !is_index(x.parent)) return false;
+
+                tokens.emplace_back(source + x.first, source + x.last, Token_Tag_Set::from_bits(x.tags));
+                tokens.back().pair = (x.pair == Serialized_Token::none ? nullptr : tokens.data() + x.pair);
+                tokens.back().parent = (x.parent == Serialized_Token::none ? nullptr : tokens.data() + x.parent);
+            }
+
+            // Enough for traversing the tree safely.
+            for (auto& tk: tokens)
+                if (tk.pair && tk.pair->pair != &tk)
+                    return false;
+
+            return tokens.back().tags.has_all_of(Token_Tag::end);
+        }
+
+        auto clear() -> void
+        {
+            Token_Tree_Error error;
+            reset("", error);
+        }
+
+        auto begin() const -> Token const* { return tokens.data(); }
+        auto   end() const -> Token const* { return tokens.data() + tokens.size() - 1; }
+
+        auto source_of_tree() const { return source; }
+        auto includes_of_tree() const { return Include_Directives{includes.data(), includes.data() + includes.size()}; }
         auto source_location_of(char const* at) const { return sol_index.source_location_of(at); }
+        auto start_of_line(std::size_t line) const { return sol_index.start_of_line(line); }
+
+        template <class Iterator, class At>
+        auto source_locations_of(Iterator first, Iterator last, At at, Source_Location* out, unsigned jobs) const
+        {
+            if (jobs == 1) sol_index.source_locations_of(first, last, at, out);
+            else sol_index.source_locations_of_parallel(first, last, at, out, jobs);
+        }
+
+        // See Token_Tree::record_includes().
+        bool records_includes{};
 
     private:
-        char const* source;
+        template <class Value>
+        using Allocator = util::Arena_Allocator<Value>;
+
+        char const* source{};
         token_tree::Start_of_Line_Index sol_index;
-        std::vector<Token> tokens;
+        Token_Tree_Diagnostics* diagnostics{};
+        std::vector<Token, Allocator<Token>> tokens;
+
+        // Whether any error was recovered from, in building the tokens.
+        bool recovered{};
+
+        // Scratch stacks of build_token_pairs() and build_token_tree().
+        std::vector<Token*, Allocator<Token*>> blocks;
+        std::vector<Token const*, Allocator<Token const*>> parents;
+
+        // Scratch tokens of apply_edit().
+        std::vector<Token, Allocator<Token>> edited;
+
+        std::vector<Include_Directive, Allocator<Include_Directive>> includes;
+
+        auto recovering() const { return (diagnostics != nullptr); }
+
+        // Returns whether to go on after the error, i.e. whether in recovery mode.
+        auto recover(Token_Tree_Error& error) -> bool
+        {
+            if (!recovering()) return false;
 
-        auto begin() { return tokens.data(); }
-        auto   end() { return tokens.data() + tokens.size() - 1; }
+            recovered = true;
+            diagnostics->add(error);
+            error.kind = Token_Tree_Error_Kind::none;
+            return true;
+        }
+
+        auto begin() -> Token* { return tokens.data(); }
+        auto   end() -> Token* { return tokens.data() + tokens.size() - 1; }
 
-        auto scan() -> void
+        // Record the directive at directive if it is `# include "name"` or `# include <name>`.
+        auto record_include(char const* directive) -> void
+        {
+            auto p = directive + 1;
+            auto skip_blanks = [&] { while (*p == '\x20' || *p == '\t') p++; };
+
+            skip_blanks();
+            if (std::strncmp(p, "include", 7) != 0) return;
+            p += 7;
+            skip_blanks();
+
+            auto closing = (*p == '"' ? '"' : *p == '<' ? '>' : '\0');
+            if (closing == '\0') return;
+
+            auto name = ++p;
+            while (*p && *p != closing && *p != '\n') p++;
+            if (*p != closing || p == name) return;
+
+            includes.push_back({directive, name, p, (closing == '>')});
+        }
+
+        // Scans from `from`, which is source or the end of a token, appending the tokens to out.
+        // Stops before the first token (the end token included) for which resync(first) is true.
+        //
+        // Error sites count tokens from the start of out.
+        template <class Resync>
+        auto scan(char const* from, std::vector<Token, Allocator<Token>>& out, Resync resync, Token_Tree_Error& error) -> bool
         {
             // These symbols are special-cased:
             //
@@ -232,22 +629,29 @@ namespace cctt
                 CASE_WHITESPACE: \
                 case ')': case '\\'
 
-            auto first = source;
-            auto  last = source;
+            auto first = from;
+            auto  last = from;
 
-            tokens.reserve(estimate_token_count(source));
+            auto resynced = false;
             auto commit = [&] (auto... tags) {
-                tokens.emplace_back(first, last, Token_Tag_Set{tags...});
+                if (resync(first)) resynced = true;
+                else out.emplace_back(first, last, Token_Tag_Set{tags...});
+            };
+
+            // Returns whether to go on scanning, i.e. whether in recovery mode.
+            // If so, the caller recovers by itself.
+            auto fail = [&] (Token_Tree_Error_Kind kind) {
+                error.kind = kind;
+                error.at = { out.size(), std::size_t(first - source), std::size_t(last - source) };
+                return recover(error);
             };
 
-            auto abort = [&] (char const* reason) {
-                auto loc = sol_index.source_location_of(first);
-                throw_scanning_error(loc, first, last, reason);
+            auto skip_to_end_of_line = [&] {
+                while (*last && *last != '\n') last++;
             };
 
-            auto abort_missing = [&] (char const* pair) {
-                auto loc = sol_index.source_location_of(first);
-                throw_scanning_error_of_missing_pair(loc, first, last, pair);
+            auto skip_to_end_of_source = [&] {
+                last += std::strlen(last);
             };
 
             // Make sure `last` is on current line!
@@ -266,29 +670,35 @@ namespace cctt
                 }
             };
 
+            // The following skip_after_*() return false if target is not found.
+
             auto skip_after_non_escaped_ch = [&] (char target) {
                 for (auto p=last; *p; p++) {
-                    if (*p == '\\') { p++; continue; }
+                    if (*p == '\\') {
+                        // An escape at the end of source escapes nothing.
+                        if (*++p == '\0') break;
+                        continue;
+                    }
                     if (*p != target) continue;
 
                     last = p + 1;
-                    return;
+                    return true;
                 }
 
-                char pair[2] = { target, '\0' };
-                abort_missing(pair);
+                return false;
             };
 
             auto skip_after_str_of_known_length = [&] (char const* target, std::size_t target_len) {
                 if (auto p = std::strstr(last, target)) {
                     last = p + target_len;
-                } else {
-                    abort_missing(target);
+                    return true;
                 }
+
+                return false;
             };
 
             auto skip_after_str = [&] (auto& target) {
-                skip_after_str_of_known_length(target, token_tree::string_length(target));
+                return skip_after_str_of_known_length(target, token_tree::string_length(target));
             };
 
             auto skip_digits = [&] {
@@ -306,10 +716,10 @@ namespace cctt
             };
 
             // Skip the so-called UTF-8 BOM at the beginning of file.
-            if (last[0] == '\xef' && last[1] == '\xbb' && last[2] == '\xbf')
+            if (from == source && last[0] == '\xef' && last[1] == '\xbb' && last[2] == '\xbf')
                 last += 3;
 
-            while (*last) {
+            while (*last && !resynced) {
                 first = last;
 
                 switch (*last++) {
@@ -351,6 +761,7 @@ namespace cctt
 
                     case '#':
                         last--;
+                        if (records_includes) record_include(first);
                         skip_until_next_line();
                         // no commit(...) to ignore directives
                         break;
@@ -364,7 +775,10 @@ namespace cctt
 
                         if (*last == '*') {
                             last++;
-                            skip_after_str("*/");
+                            if (!skip_after_str("*/")) {
+                                if (!fail(Token_Tree_Error_Kind::unterminated_comment)) return false;
+                                skip_to_end_of_source();
+                            }
                             // no commit(...) to ignore multi-line comments
                             break;
                         }
@@ -374,12 +788,18 @@ namespace cctt
                         break;
 
                     case '"':
-                        skip_after_non_escaped_ch('"');
+                        if (!skip_after_non_escaped_ch('"')) {
+                            if (!fail(Token_Tree_Error_Kind::unterminated_literal)) return false;
+                            skip_to_end_of_line();
+                        }
                         commit(Token_Tag::literal, Token_Tag::string, Token_Tag::line);
                         break;
 
                     case '\'':
-                        skip_after_non_escaped_ch('\'');
+                        if (!skip_after_non_escaped_ch('\'')) {
+                            if (!fail(Token_Tree_Error_Kind::unterminated_literal)) return false;
+                            skip_to_end_of_line();
+                        }
                         commit(Token_Tag::literal, Token_Tag::character);
                         break;
 
@@ -404,7 +824,7 @@ namespace cctt
                         // raw strings may starts with:
                         //     R"  u8R"  uR"  UR"  LR"
                         if (last[0] == '"' && last[-1] == 'R') {
-                            last++;
+                            auto quote = last++;
 
                             constexpr auto max_delimiter_length = 16;   // defined by the C++ Standard
                             char closing[1+max_delimiter_length+1+1];
@@ -412,16 +832,25 @@ namespace cctt
                             *p++ = ')';
 
                             auto is_delimiter = true;
+                            auto is_raw = true;
+                            auto has_closing = true;
                             for (int i=0; is_delimiter && i < max_delimiter_length; i++) {
                                 switch (*last) {
                                     case '\0':
-                                        abort("raw string requires R\"DELIMITER( )DELIMITER\"");
-                                        token_tree::unreachable();
+                                        if (!fail(Token_Tree_Error_Kind::incomplete_raw_string)) return false;
+                                        // Recovery: the raw string runs to the end of source.
+                                        is_delimiter = false;
+                                        has_closing = false;
+                                        break;
 
                                     CASE_RAW_STRING_DELIMITER_BLACKLIST:
                                         last++;
-                                        abort("invalid raw string delimiter.");
-                                        token_tree::unreachable();
+                                        if (!fail(Token_Tree_Error_Kind::invalid_raw_string_delimiter)) return false;
+                                        // Recovery: the prefix is an identifier, and `"` starts an ordinary string.
+                                        last = quote;
+                                        is_delimiter = false;
+                                        is_raw = false;
+                                        break;
 
                                     case '(':
                                         is_delimiter = false;
@@ -434,10 +863,18 @@ namespace cctt
                                 }
                             }
 
+                            if (!is_raw) {
+                                commit(Token_Tag::identifier);
+                                break;
+                            }
+
                             *p++ = '"';
                             *p = '\0';
 
-                            skip_after_str_of_known_length(closing, p-closing);
+                            if (has_closing && !skip_after_str_of_known_length(closing, p-closing)) {
+                                if (!fail(Token_Tree_Error_Kind::unterminated_raw_string)) return false;
+                                skip_to_end_of_source();
+                            }
                             commit(Token_Tag::literal, Token_Tag::string, Token_Tag::block);
                         } else {
                             commit(Token_Tag::identifier);
@@ -446,17 +883,22 @@ namespace cctt
                     }
 
                     default:
-                        abort("unknown character.");
-                        token_tree::unreachable();
+                        if (!fail(Token_Tree_Error_Kind::unknown_character)) return false;
+                        // Recovery: skip the character.
+                        break;
                 }
             }
 
             // sentinel
-            first = last;
-            commit(Token_Tag::end);
+            if (!resynced) {
+                first = last;
+                commit(Token_Tag::end);
+            }
+            return true;
         }
 
-        auto build_token_pairs() -> void
+        // Pairs the tokens in [first, last), assuming none of them is paired yet.
+        auto build_token_pairs(Token* first, Token* last, Token_Tree_Error& error) -> bool
         {
             #define CASE_AMBIGUOUS_OPEN_SYMBOL \
                 case '<'
@@ -487,54 +929,48 @@ namespace cctt
                 }
             };
 
-            auto paired_closing_symbol_of = [] (char ch) {
-                switch (ch) {
-                    case '<': return '>';
-                    case '(': return ')';
-                    case '[': return ']';
-                    case '{': return '}';
-                    default: token_tree::unreachable();
-                }
-            };
-
             // Assume `tk` is a token of single-character symbol
             auto symbol_of = [] (Token const* tk) {
                 return tk->first[0];
             };
 
-            auto abort_unpaired = [&, this] (Token const* open, Token const* closing) {
-                if (open && closing) {
-                    auto open_loc = sol_index.source_location_of(open->first);
-                    auto closing_loc = sol_index.source_location_of(closing->first);
-                    throw_parsing_error_of_unpaired_pair(
-                        open_loc, open,
-                        closing_loc, closing
-                    );
-                }
+            auto site_of = [this] (Token const* tk) {
+                return Token_Tree_Error::Site{
+                    std::size_t(tk - tokens.data()),
+                    std::size_t(tk->first - source),
+                    std::size_t(tk->last - source),
+                };
+            };
 
-                if (open) {
-                    auto loc = sol_index.source_location_of(open->first);
-                    char missing_pair[] = { paired_closing_symbol_of(symbol_of(open)), '\0' };
-                    throw_parsing_error_of_missing_pair(loc, open, missing_pair);
+            // Returns whether to go on pairing, i.e. whether in recovery mode.
+            auto fail_unpaired = [&] (Token const* open, Token const* closing) {
+                if (open && closing) {
+                    error.kind = Token_Tree_Error_Kind::unpaired_pair;
+                    error.at = site_of(open);
+                    error.other = site_of(closing);
+                } else if (open) {
+                    error.kind = Token_Tree_Error_Kind::missing_closing_pair;
+                    error.at = site_of(open);
+                } else {
+                    error.kind = Token_Tree_Error_Kind::missing_open_pair;
+                    error.at = site_of(closing);
                 }
 
-                if (closing) {
-                    auto loc = sol_index.source_location_of(closing->first);
-                    char missing_pair[] = { paired_open_symbol_of(symbol_of(closing)), '\0' };
-                    throw_parsing_error_of_missing_pair(loc, closing, missing_pair);
-                }
+                return recover(error);
+            };
 
-                token_tree::unreachable();
+            // Recovery: an unpaired symbol becomes a leaf, which will not be mistaken for a block.
+            auto demote = [] (Token* tk) {
+                tk->tags.disable(Token_Tag::symbol).enable(Token_Tag::invalid);
             };
 
-            std::vector<Token*> blocks;
-            blocks.reserve(tokens.size());
+            blocks.clear();
+            blocks.reserve(std::size_t(last - first));
 
-            for (auto& token: *this) {
-                if (token.tags.has_none_of(Token_Tag::symbol)) continue;
-                if (token.last - token.first != 1) continue;
+            for (auto tk=first; tk != last; tk++) {
+                if (tk->tags.has_none_of(Token_Tag::symbol)) continue;
+                if (tk->last - tk->first != 1) continue;
 
-                auto tk = &token;
                 auto sym = symbol_of(tk);
 
                 switch (sym) {
@@ -564,8 +1000,9 @@ namespace cctt
                             switch (sym) {
                                 CASE_AMBIGUOUS_CLOSING_SYMBOL: break;
                                 default:
-                                    abort_unpaired(nullptr, tk);
-                                    token_tree::unreachable();
+                                    if (!fail_unpaired(nullptr, tk)) return false;
+                                    demote(tk);
+                                    break;
                             }
                         } else {
                             auto open_token = blocks.back();
@@ -578,9 +1015,37 @@ namespace cctt
                             } else {
                                 switch (sym) {
                                     CASE_AMBIGUOUS_CLOSING_SYMBOL: break;
-                                    default:
-                                        abort_unpaired(open_token, tk);
-                                        token_tree::unreachable();
+                                    default: {
+                                        // Recovery: if an outer block is paired with tk,
+                                        // the blocks inside it are missing their closing pairs.
+                                        // Otherwise, tk is missing its open pair.
+                                        auto outer = std::find_if(blocks.rbegin(), blocks.rend(), [&] (Token const* open) {
+                                            return (symbol_of(open) == paired_open_symbol_of(sym));
+                                        });
+
+                                        if (!recovering()) return fail_unpaired(open_token, tk);
+
+                                        // open_token is reported only if it stays unpaired to the end.
+                                        if (outer == blocks.rend()) {
+                                            fail_unpaired(nullptr, tk);
+                                            demote(tk);
+                                            break;
+                                        }
+
+                                        auto outer_token = *outer;
+                                        while (blocks.back() != outer_token) {
+                                            if (!is_ambiguous_open_symbol(symbol_of(blocks.back()))) {
+                                                fail_unpaired(blocks.back(), nullptr);
+                                                demote(blocks.back());
+                                            }
+                                            blocks.pop_back();
+                                        }
+
+                                        blocks.pop_back();
+                                        outer_token->pair = tk;
+                                        tk->pair = outer_token;
+                                        break;
+                                    }
                                 }
                             }
                         }
@@ -594,21 +1059,26 @@ namespace cctt
             while (!blocks.empty() && is_ambiguous_open_symbol(symbol_of(blocks.back())))
                 blocks.pop_back();
 
-            if (!blocks.empty()) {
-                abort_unpaired(blocks.back(), nullptr);
-                token_tree::unreachable();
+            // Recovery: report from the innermost, as without recovery.
+            while (!blocks.empty()) {
+                if (!is_ambiguous_open_symbol(symbol_of(blocks.back()))) {
+                    if (!fail_unpaired(blocks.back(), nullptr)) return false;
+                    demote(blocks.back());
+                }
+                blocks.pop_back();
             }
+
+            return true;
         }
 
-        auto build_token_tree() -> void
+        // Links the tokens in [first, last), which are inside parent (nullptr for the root), to their parents.
+        auto build_token_tree(Token* first, Token* last, Token const* parent) -> void
         {
-            std::vector<Token const*> parents;
-            parents.reserve(tokens.size());
-            parents.emplace_back(nullptr);
-
-            for (auto& token: *this) {
-                auto tk = &token;
+            parents.clear();
+            parents.reserve(std::size_t(last - first) + 1);
+            parents.emplace_back(parent);
 
+            for (auto tk=first; tk != last; tk++) {
                 if (tk->pair == nullptr) {
                     tk->parent = parents.back();
                     continue;
@@ -645,12 +1115,117 @@ namespace cctt
         }
     };
 
+    Token_Tree::Token_Tree()
+        : impl{std::make_unique<Impl>()}
+    {}
+
     Token_Tree::Token_Tree(char const* source)
-        : impl{std::make_unique<Impl>(source)}
+        : Token_Tree{}
+    {
+        reset(source);
+    }
+
+    Token_Tree::Token_Tree(util::Arena& arena)
+        : impl{std::make_unique<Impl>(&arena)}
     {}
 
+    Token_Tree::Token_Tree(char const* source, util::Arena& arena)
+        : Token_Tree{arena}
+    {
+        reset(source);
+    }
+
+    Token_Tree::Token_Tree(Token_Tree&&) noexcept = default;
+    auto Token_Tree::operator = (Token_Tree&&) noexcept -> Token_Tree& = default;
     Token_Tree::~Token_Tree() = default;
 
+    auto Token_Tree::try_build(char const* source, Token_Tree_Error& error) -> nonstd::optional<Token_Tree>
+    {
+        Token_Tree tt;
+        if (!tt.try_reset(source, error)) return nonstd::nullopt;
+        return tt;
+    }
+
+    auto Token_Tree::build_with_recovery(char const* source, Token_Tree_Diagnostics& diagnostics) -> Token_Tree
+    {
+        Token_Tree tt;
+        tt.reset_with_recovery(source, diagnostics);
+        return tt;
+    }
+
+    auto Token_Tree::reset(char const* source) -> void
+    {
+        Token_Tree_Error error;
+        if (!try_reset(source, error)) throw Parsing_Error{error.message()};
+    }
+
+    auto Token_Tree::try_reset(char const* source, Token_Tree_Error& error) -> bool
+    {
+        if (!impl) impl = std::make_unique<Impl>();
+
+        impl->reset(source, error);
+        if (!error) return true;
+
+        impl->clear();
+        return false;
+    }
+
+    auto Token_Tree::apply_edit(char const* source, std::size_t offset, std::size_t removed_size, std::size_t inserted_size) -> void
+    {
+        Token_Tree_Error error;
+        if (!try_apply_edit(source, offset, removed_size, inserted_size, error)) throw Parsing_Error{error.message()};
+    }
+
+    auto Token_Tree::try_apply_edit(char const* source, std::size_t offset, std::size_t removed_size, std::size_t inserted_size, Token_Tree_Error& error) -> bool
+    {
+        if (!impl) impl = std::make_unique<Impl>();
+
+        impl->apply_edit(source, offset, removed_size, inserted_size, error);
+        if (!error) return true;
+
+        impl->clear();
+        return false;
+    }
+
+    auto Token_Tree::apply_edit(std::string& source, std::size_t offset, std::size_t removed_size, std::string const& inserted) -> void
+    {
+        auto old_size = source.size();
+        if (offset > old_size || removed_size > old_size - offset) throw std::out_of_range{"The edit is out of the source."};
+
+        source.replace(offset, removed_size, inserted);
+        apply_edit(source.data(), offset, removed_size, inserted.size());
+    }
+
+    auto Token_Tree::try_load(char const* source, char const* first, char const* last) -> bool
+    {
+        if (!impl) impl = std::make_unique<Impl>();
+
+        if (impl->load(source, first, last)) return true;
+
+        impl->clear();
+        return false;
+    }
+
+    auto Token_Tree::reset_with_recovery(char const* source, Token_Tree_Diagnostics& diagnostics) -> void
+    {
+        if (!impl) impl = std::make_unique<Impl>();
+
+        Token_Tree_Error error;
+        impl->reset(source, error, &diagnostics);
+    }
+
+    auto Token_Tree::record_includes(bool on) -> void
+    {
+        if (!impl) impl = std::make_unique<Impl>();
+        impl->records_includes = on;
+    }
+
+    auto Token_Tree::includes() const -> Include_Directives
+    {
+        auto const* const_impl = impl.get();
+        return const_impl->includes_of_tree();
+    }
+
     auto Token_Tree::begin() const -> Token const*
     {
         auto const* const_impl = impl.get();
@@ -663,10 +1238,34 @@ namespace cctt
         return const_impl->end();
     }
 
+    auto Token_Tree::source() const -> char const*
+    {
+        auto const* const_impl = impl.get();
+        return const_impl->source_of_tree();
+    }
+
     auto Token_Tree::source_location_of(char const* at) const -> Source_Location
     {
         auto const* const_impl = impl.get();
         return const_impl->source_location_of(at);
     }
+
+    auto Token_Tree::source_locations_of(char const* const* first, char const* const* last, Source_Location* out, unsigned jobs) const -> void
+    {
+        auto const* const_impl = impl.get();
+        const_impl->source_locations_of(first, last, [] (char const* at) { return at; }, out, jobs);
+    }
+
+    auto Token_Tree::source_locations_of(Token const* first, Token const* last, Source_Location* out, unsigned jobs) const -> void
+    {
+        auto const* const_impl = impl.get();
+        const_impl->source_locations_of(first, last, [] (Token const& tk) { return tk.first; }, out, jobs);
+    }
+
+    auto Token_Tree::start_of_line(std::size_t line) const -> char const*
+    {
+        auto const* const_impl = impl.get();
+        return const_impl->start_of_line(line);
+    }
 }
 
@@ -1,5 +1,6 @@
 #pragma once
 #include "token.hpp"
+#include <nonstd/optional.hpp>
 #include <memory>
 #include <string>
 #include <vector>
@@ -13,13 +14,107 @@ namespace cctt
         std::size_t column;
     };
 
+    // An `#include "name"` or `#include <name>` directive, which scanning skips like other directives.
+    struct Include_Directive final
+    {
+        char const* directive;      // its `#`
+        char const* first;          // the name, without its delimiters
+        char const* last;
+        bool is_angled;             // <name>
+    };
+
+    struct Include_Directives final
+    {
+        Include_Directive const* first;
+        Include_Directive const* last;
+
+        auto begin() const -> Include_Directive const* { return first; }
+        auto   end() const -> Include_Directive const* { return last; }
+        auto  size() const -> std::size_t { return std::size_t(last - first); }
+    };
+
+    // See error.hpp.
+    struct Token_Tree_Error;
+    struct Token_Tree_Diagnostics;
+
+    namespace util
+    {
+        // See util/arena.hpp.
+        struct Arena;
+    }
+
     struct Token_Tree final
     {
+        // An empty tree.
+        Token_Tree();
+
         // source must be zero-terminated.
+        // Throws Parsing_Error if source cannot be scanned or paired.
         Token_Tree(char const* source);
+
+        // Same as above, but all memory of the tree, including that for later reset()s, comes from arena.
+        // The arena must outlive the tree, and should not be reset() while the tree is in use.
+        explicit Token_Tree(util::Arena& arena);
+        Token_Tree(char const* source, util::Arena& arena);
+
+        Token_Tree(Token_Tree&&) noexcept;
+        auto operator = (Token_Tree&&) noexcept -> Token_Tree&;
         ~Token_Tree();
 
         Token_Tree(std::string const& x): Token_Tree{x.data()} {}
+        Token_Tree(std::string const& x, util::Arena& arena): Token_Tree{x.data(), arena} {}
+
+        // Same as the constructor, but on failure, nothing is thrown or formatted:
+        // error is set and nonstd::nullopt is returned.
+        static auto try_build(char const* source, Token_Tree_Error& error) -> nonstd::optional<Token_Tree>;
+
+        // Never fails: every error is added to diagnostics, and then recovered from in a single pass:
+        //
+        // - Unknown characters are skipped.
+        // - Unterminated string and character literals end at the end of line.
+        // - Unterminated comments and raw strings end at the end of source.
+        // - Raw strings with invalid delimiters are scanned as an identifier followed by a string.
+        // - Unpaired brackets become leaves tagged Token_Tag::invalid instead of Token_Tag::symbol.
+        static auto build_with_recovery(char const* source, Token_Tree_Diagnostics& diagnostics) -> Token_Tree;
+
+        // Same as above, but into this tree, reusing all its memory.
+        // Once a tree has grown large enough, rebuilding it allocates nothing;
+        // thus keep one tree per thread when processing many files.
+        //
+        // On failure, the tree is left empty.
+        auto reset(char const* source) -> void;
+        auto try_reset(char const* source, Token_Tree_Error& error) -> bool;
+        auto reset_with_recovery(char const* source, Token_Tree_Diagnostics& diagnostics) -> void;
+
+        // Same as reset(source), where source is the old source of the tree with an edit:
+        // removed_size characters at offset were replaced by inserted_size characters.
+        //
+        // Only the tokens from before the edit to where scanning gets back in step with the old tokens are scanned again,
+        // and only the innermost block around them is paired again (the whole tree, if its brackets do not balance).
+        // The other tokens are moved to the new source, in a linear pass without scanning.
+        // A tree that was recovered from errors (see reset_with_recovery()) is rebuilt from scratch.
+        //
+        // The old source needs not be alive. On failure, the tree is left empty.
+        // Throws std::out_of_range if the edit is not within the old source.
+        auto apply_edit(char const* source, std::size_t offset, std::size_t removed_size, std::size_t inserted_size) -> void;
+        auto try_apply_edit(char const* source, std::size_t offset, std::size_t removed_size, std::size_t inserted_size, Token_Tree_Error& error) -> bool;
+
+        // Same as above, but source is the old source, which is edited first.
+        auto apply_edit(std::string& source, std::size_t offset, std::size_t removed_size, std::string const& inserted) -> void;
+
+        // Rebuild the tree over source from [first, last), saved by save_token_tree() (see serialize.hpp),
+        // without scanning source again.
+        //
+        // Returns false, leaving the tree empty, if the data is malformed or does not fit source.
+        // The content of source is not checked; compare Serialized_Tree_Header::source_hash for that.
+        auto try_load(char const* source, char const* first, char const* last) -> bool;
+
+        // Whether later resets record the `#include` directives of their sources, in order, into includes().
+        // Off by default. Directives naming a macro are not recorded.
+        //
+        // While on, apply_edit() rebuilds the whole tree. Trees loaded by try_load() have no directives.
+        auto record_includes(bool on) -> void;
+        auto includes() const -> Include_Directives;
 
         // begin() returns pointer to the first token (which will be end() if there is no token).
         // end()   returns pointer to the token with Token_Tag::end.
@@ -31,8 +126,25 @@ namespace cctt
         auto begin() const -> Token const*;
         auto   end() const -> Token const*;
 
+        // The source which the tree was built from. It is "" for an empty tree.
+        auto source() const -> char const*;
+
+        // at must be within the source, or at its end (e.g. the first of the end token),
+        // which is on the last line, just after its last character.
         auto source_location_of(char const* at) const -> Source_Location;
 
+        // Same as source_location_of() for each pointer in [first, last), or for the first of each token,
+        // written to out[0], out[1], ...
+        //
+        // The input must be sorted; then all of it is resolved in one linear pass over the line index.
+        // Inputs are split across jobs threads when large enough. (jobs == 0 means all hardware threads.)
+        auto source_locations_of(char const* const* first, char const* const* last, Source_Location* out, unsigned jobs=1) const -> void;
+        auto source_locations_of(Token const* first, Token const* last, Source_Location* out, unsigned jobs=1) const -> void;
+
+        // Lines are 1-based, as in Source_Location.
+        // Returns the end of source if line is past the last line.
+        auto start_of_line(std::size_t line) const -> char const*;
+
     private:
         struct Impl;
         std::unique_ptr<Impl> impl;
@@ -18,6 +18,9 @@ namespace cctt
         block,
         line,
 
+        // An unpaired bracket, kept as a leaf when recovering from errors.
+        invalid,
+
         last_tag_,
     };
 
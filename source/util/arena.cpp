@@ -0,0 +1,104 @@
+#include "arena.hpp"
+#include <algorithm>
+#include <new>
+#include <cstdint>
+#include <sys/mman.h>
+
+namespace cctt
+{
+    namespace util
+    {
+        namespace
+        {
+            constexpr auto huge_page_size = std::size_t(2) << 20;
+
+            auto round_up(std::size_t x, std::size_t multiple) -> std::size_t
+            {
+                return (x + multiple - 1) / multiple * multiple;
+            }
+
+            auto map_chunk(std::size_t size, bool huge_pages) -> char*
+            {
+                auto p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (p == MAP_FAILED) throw std::bad_alloc{};
+
+                #ifdef MADV_HUGEPAGE
+                    // Only a hint: it's fine if the kernel does not support it.
+                    if (huge_pages) ::madvise(p, size, MADV_HUGEPAGE);
+                #endif
+
+                return static_cast<char*>(p);
+            }
+        }
+
+        Arena::Arena(std::size_t chunk_size, bool huge_pages)
+            : chunk_size{round_up(std::max(chunk_size, huge_page_size), huge_page_size)}
+            , huge_pages{huge_pages}
+        {}
+
+        Arena::~Arena()
+        {
+            for (auto& chunk: chunks)
+                ::munmap(chunk.data, chunk.size);
+        }
+
+        auto Arena::allocate(std::size_t size, std::size_t align) -> void*
+        {
+            auto p = reinterpret_cast<char*>(round_up(reinterpret_cast<std::uintptr_t>(next), align));
+            if (next == nullptr || p > end || std::size_t(end - p) < size) {
+                use_next_chunk(size + align);
+                p = reinterpret_cast<char*>(round_up(reinterpret_cast<std::uintptr_t>(next), align));
+            }
+
+            next = p + size;
+            return p;
+        }
+
+        auto Arena::reset() -> void
+        {
+            current = 0;
+            used_in_previous_chunks = 0;
+
+            if (chunks.empty()) {
+                next = end = nullptr;
+            } else {
+                next = chunks[0].data;
+                end = next + chunks[0].size;
+            }
+        }
+
+        auto Arena::used() const -> std::size_t
+        {
+            if (next == nullptr) return 0;
+            return used_in_previous_chunks + std::size_t(next - chunks[current].data);
+        }
+
+        auto Arena::reserved() const -> std::size_t
+        {
+            std::size_t size{};
+            for (auto& chunk: chunks) size += chunk.size;
+            return size;
+        }
+
+        // Chunks kept by reset() are reused in order; the ones too small for this request are skipped.
+        auto Arena::use_next_chunk(std::size_t least_size) -> void
+        {
+            if (next != nullptr) {
+                used_in_previous_chunks += std::size_t(next - chunks[current].data);
+                current++;
+            }
+
+            while (current < chunks.size() && chunks[current].size < least_size)
+                current++;
+
+            if (current == chunks.size()) {
+                auto size = round_up(std::max(chunk_size, least_size), huge_page_size);
+                chunks.push_back({ map_chunk(size, huge_pages), size });
+            }
+
+            next = chunks[current].data;
+            end = next + chunks[current].size;
+        }
+    }
+}
+
@@ -0,0 +1,93 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include <cstddef>
+
+namespace cctt
+{
+    namespace util
+    {
+        // A monotonic (bump) allocator over a few large chunks of memory.
+        //
+        // Memory is only given back all at once, by reset() or the destructor;
+        // thus objects allocated in an Arena must be trivially destructible,
+        // or destroyed by their owners.
+        //
+        // Not thread-safe: use one Arena per thread.
+        struct Arena final
+        {
+            // Chunks are at least chunk_size bytes, rounded up to 2 MiB.
+            // With huge_pages, the kernel is asked to back chunks with huge pages when available.
+            Arena(std::size_t chunk_size=std::size_t(16) << 20, bool huge_pages=true);
+            ~Arena();
+
+            Arena(Arena const&) = delete;
+            auto operator = (Arena const&) -> Arena& = delete;
+
+            // Throws std::bad_alloc if the system is out of memory.
+            auto allocate(std::size_t size, std::size_t align) -> void*;
+
+            // Make all memory allocated so far available again.
+            // The chunks are kept, so that the next round of allocations maps nothing.
+            auto reset() -> void;
+
+            // Bytes handed out since the last reset(), including padding.
+            auto used() const -> std::size_t;
+
+            // Bytes mapped in all chunks.
+            auto reserved() const -> std::size_t;
+
+        private:
+            struct Chunk final
+            {
+                char* data;
+                std::size_t size;
+            };
+
+            std::vector<Chunk> chunks;
+            std::size_t current{};      // index of the chunk being bumped
+            char* next{};
+            char* end{};
+            std::size_t used_in_previous_chunks{};
+
+            std::size_t chunk_size;
+            bool huge_pages;
+
+            auto use_next_chunk(std::size_t least_size) -> void;
+        };
+
+        // A standard allocator on top of an Arena. Deallocation does nothing.
+        // Without an Arena, it falls back to std::allocator.
+        template <class Value>
+        struct Arena_Allocator
+        {
+            using value_type = Value;
+
+            Arena_Allocator() = default;
+            Arena_Allocator(Arena* arena): arena{arena} {}
+
+            template <class Other>
+            Arena_Allocator(Arena_Allocator<Other> const& x): arena{x.arena} {}
+
+            auto allocate(std::size_t n) -> value_type*
+            {
+                if (arena == nullptr) return std::allocator<value_type>{}.allocate(n);
+                return static_cast<value_type*>(arena->allocate(n * sizeof(value_type), alignof(value_type)));
+            }
+
+            auto deallocate(value_type* p, std::size_t n) -> void
+            {
+                if (arena == nullptr) std::allocator<value_type>{}.deallocate(p, n);
+            }
+
+            template <class Other>
+            friend auto operator == (Arena_Allocator const& a, Arena_Allocator<Other> const& b) -> bool { return (a.arena == b.arena); }
+
+            template <class Other>
+            friend auto operator != (Arena_Allocator const& a, Arena_Allocator<Other> const& b) -> bool { return (a.arena != b.arena); }
+
+            Arena* arena{};
+        };
+    }
+}
+
@@ -1,5 +1,8 @@
 #pragma once
-#include <memory>
+#include "arena.hpp"
+#include <type_traits>
+#include <new>
+#include <utility>
 #include <cstddef>
 
 #include "const-helper.macro.hpp"
@@ -12,6 +15,9 @@ namespace cctt
         //
         // The main design goal of the Buffer is that, unlike std::vector,
         // the Buffer does default initialization (won't zero out the memory when possible).
+        //
+        // The array comes from new[] by default, or from an Arena if one is given,
+        // in which case the Arena outlives the Buffer and value_type must be trivially destructible.
         template <class Value>
         struct Buffer
         {
@@ -23,18 +29,68 @@ namespace cctt
             Buffer(std::size_t size_)
                 : data_{new value_type [size_]}
                 , size_{size_}
+                , capacity_{size_}
             {}
 
             // initialized buffer
             Buffer(std::size_t size_, value_type initial_)
                 : data_{new value_type [size_]{initial_}}
                 , size_{size_}
+                , capacity_{size_}
+            {}
+
+            // empty buffer, whose memory will come from arena
+            explicit Buffer(Arena& arena_)
+                : arena_{&arena_}
+            {
+                static_assert(std::is_trivially_destructible<value_type>{}, "Memory from an Arena is never destructed.");
+            }
+
+            // uninitialized buffer in arena
+            Buffer(std::size_t size_, Arena& arena_)
+                : Buffer{arena_}
+            {
+                reset(size_);
+            }
+
+            Buffer(Buffer&& x) noexcept
+                : data_{std::exchange(x.data_, nullptr)}
+                , size_{std::exchange(x.size_, 0)}
+                , capacity_{std::exchange(x.capacity_, 0)}
+                , arena_{x.arena_}
             {}
 
+            auto operator = (Buffer&& x) noexcept -> Buffer&
+            {
+                if (this != &x) {
+                    release();
+                    data_ = std::exchange(x.data_, nullptr);
+                    size_ = std::exchange(x.size_, 0);
+                    capacity_ = std::exchange(x.capacity_, 0);
+                    arena_ = x.arena_;
+                }
+                return *this;
+            }
+
+            ~Buffer() { release(); }
+
+            // Resize to an uninitialized buffer.
+            // The memory is reused if it is large enough, so that no allocation happens in steady state.
+            auto reset(std::size_t size) -> void
+            {
+                if (size > capacity_) {
+                    release();
+                    data_ = allocate(size);
+                    capacity_ = size;
+                }
+                size_ = size;
+            }
+
             auto size() const { return size_; }
+            auto capacity() const { return capacity_; }
 
             CONST_HELPER(
-                auto data() CONST { return data_.get(); }
+                auto data() CONST { return data_; }
             );
 
             CONST_HELPER(
@@ -45,8 +101,26 @@ namespace cctt
             CONST_HELPER( auto   end() CONST { return &data_[size_]; } );
 
         private:
-            std::unique_ptr<value_type []> data_{};
+            value_type* data_{};
             std::size_t size_{};
+            std::size_t capacity_{};
+            Arena* arena_{};
+
+            auto allocate(std::size_t size) -> value_type*
+            {
+                if (arena_ == nullptr) return new value_type [size];
+
+                auto p = static_cast<value_type*>(arena_->allocate(size * sizeof(value_type), alignof(value_type)));
+                for (std::size_t i=0; i < size; i++) ::new (p + i) value_type;
+                return p;
+            }
+
+            auto release() -> void
+            {
+                if (arena_ == nullptr) delete [] data_;
+                data_ = nullptr;
+                size_ = capacity_ = 0;
+            }
         };
     }
 }
@@ -1,7 +1,9 @@
 #include "file.hpp"
 #include <fstream>
-#include <sstream>
+#include <iterator>
+#include <cstdint>
 #include <stdexcept>
+#include <sys/stat.h>
 
 namespace cctt
 {
@@ -11,14 +13,33 @@ namespace cctt
         {
             auto slurp(char const* path) -> std::string
             {
-                if (std::ifstream ifs{path, std::ios::binary}) {
-                    std::stringstream ss;
-                    ss << ifs.rdbuf();
-                    return ss.str();
-                }
-                else {
+                std::string content;
+                slurp(path, content);
+                return content;
+            }
+
+            auto slurp(char const* path, std::string& content) -> void
+            {
+                // Only regular files have a size; pipes and devices are read as a stream, anything else is refused.
+                struct stat st;
+                if (::stat(path, &st) != 0) throw std::runtime_error{"Cannot load file: " + std::string{path}};
+                if (!S_ISREG(st.st_mode) && !S_ISFIFO(st.st_mode) && !S_ISCHR(st.st_mode))
                     throw std::runtime_error{"Cannot load file: " + std::string{path}};
+
+                std::ifstream ifs{path, std::ios::binary};
+                if (!ifs) throw std::runtime_error{"Cannot load file: " + std::string{path}};
+
+                auto size = (S_ISREG(st.st_mode) ? ifs.seekg(0, std::ios::end).tellg() : std::streampos(-1));
+                if (size < 0) {
+                    ifs.clear();
+                    content.assign(std::istreambuf_iterator<char>{ifs}, std::istreambuf_iterator<char>{});
+                    return;
                 }
+                if (std::uint64_t(size) > content.max_size()) throw std::runtime_error{"Cannot load file: " + std::string{path}};
+
+                content.resize(std::size_t(size));
+                ifs.seekg(0);
+                if (!ifs.read(&content[0], size)) throw std::runtime_error{"Cannot load file: " + std::string{path}};
             }
         }
     }
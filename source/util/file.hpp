@@ -8,6 +8,9 @@ namespace cctt
         inline namespace file
         {
             auto slurp(char const* path) -> std::string;
+
+            // Same as above, but reuses the capacity of content.
+            auto slurp(char const* path, std::string& content) -> void;
         }
     }
 }
@@ -65,6 +65,14 @@ namespace cctt
             constexpr auto operator [] (Flag_Set fs) const -> Flag_Set { return fs.filter(*this); }
 
             constexpr auto get() const -> flag_int_type { return flags; }
+
+            // The inverse of get().
+            static constexpr auto from_bits(flag_int_type bits) -> Flag_Set
+            {
+                Flag_Set fs;
+                fs.flags = bits;
+                return fs;
+            }
             constexpr explicit operator flag_int_type () const { return get(); }
 
             friend constexpr auto operator == (Flag_Set a, Flag_Set b) -> bool { return (a.get() == b.get()); }
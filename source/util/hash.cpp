@@ -0,0 +1,82 @@
+#include "hash.hpp"
+#include <cstring>
+
+namespace cctt
+{
+    namespace util
+    {
+        namespace
+        {
+            constexpr std::uint64_t prime1 = 0x9e3779b185ebca87ull;
+            constexpr std::uint64_t prime2 = 0xc2b2ae3d27d4eb4full;
+            constexpr std::uint64_t prime3 = 0x165667b19e3779f9ull;
+            constexpr std::uint64_t prime4 = 0x85ebca77c2b2ae63ull;
+            constexpr std::uint64_t prime5 = 0x27d4eb2f165667c5ull;
+
+            auto rotl(std::uint64_t x, int r) -> std::uint64_t
+            {
+                return (x << r) | (x >> (64 - r));
+            }
+
+            // Unaligned, host-endian reads.
+            auto read64(unsigned char const* p) -> std::uint64_t
+            {
+                std::uint64_t x;
+                std::memcpy(&x, p, sizeof(x));
+                return x;
+            }
+
+            auto read32(unsigned char const* p) -> std::uint64_t
+            {
+                std::uint32_t x;
+                std::memcpy(&x, p, sizeof(x));
+                return x;
+            }
+
+            auto round(std::uint64_t acc, std::uint64_t input) -> std::uint64_t
+            {
+                return rotl(acc + input * prime2, 31) * prime1;
+            }
+
+            auto merge_round(std::uint64_t acc, std::uint64_t lane) -> std::uint64_t
+            {
+                return (acc ^ round(0, lane)) * prime1 + prime4;
+            }
+        }
+
+        auto hash64(void const* data, std::size_t size, std::uint64_t seed) -> std::uint64_t
+        {
+            auto p = static_cast<unsigned char const*>(data);
+            auto last = p + size;
+            std::uint64_t h;
+
+            if (size >= 32) {
+                std::uint64_t lanes[4] = { seed + prime1 + prime2, seed + prime2, seed, seed - prime1 };
+
+                for (; last - p >= 32; p += 32)
+                    for (int i=0; i < 4; i++)
+                        lanes[i] = round(lanes[i], read64(p + 8*i));
+
+                h = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18);
+                for (auto lane: lanes) h = merge_round(h, lane);
+            } else {
+                h = seed + prime5;
+            }
+
+            h += size;
+
+            for (; last - p >= 8; p += 8) h = rotl(h ^ round(0, read64(p)), 27) * prime1 + prime4;
+            for (; last - p >= 4; p += 4) h = rotl(h ^ (read32(p) * prime1), 23) * prime2 + prime3;
+            for (; p < last; p++) h = rotl(h ^ (*p * prime5), 11) * prime1;
+
+            h ^= h >> 33;
+            h *= prime2;
+            h ^= h >> 29;
+            h *= prime3;
+            h ^= h >> 32;
+
+            return h;
+        }
+    }
+}
+
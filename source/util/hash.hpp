@@ -0,0 +1,13 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+namespace cctt
+{
+    namespace util
+    {
+        // A fast, non-cryptographic 64-bit hash of bytes (XXH64).
+        auto hash64(void const* data, std::size_t size, std::uint64_t seed=0) -> std::uint64_t;
+    }
+}
+
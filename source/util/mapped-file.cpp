@@ -0,0 +1,34 @@
+#include "mapped-file.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace cctt
+{
+    namespace util
+    {
+        Mapped_File::Mapped_File(char const* path)
+        {
+            auto fd = ::open(path, O_RDONLY | O_CLOEXEC);
+            if (fd < 0) return;
+
+            struct stat st;
+            if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+                auto p = ::mmap(nullptr, std::size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+                if (p != MAP_FAILED) {
+                    data_ = static_cast<char const*>(p);
+                    size_ = std::size_t(st.st_size);
+                }
+            }
+
+            ::close(fd);
+        }
+
+        Mapped_File::~Mapped_File()
+        {
+            if (data_) ::munmap(const_cast<char*>(data_), size_);
+        }
+    }
+}
+
@@ -0,0 +1,27 @@
+#pragma once
+#include <cstddef>
+
+namespace cctt
+{
+    namespace util
+    {
+        // A read-only, private mapping of a whole file.
+        // If the file cannot be opened or mapped, or is empty, data() is nullptr.
+        struct Mapped_File final
+        {
+            Mapped_File(char const* path);
+            ~Mapped_File();
+
+            Mapped_File(Mapped_File const&) = delete;
+            auto operator = (Mapped_File const&) -> Mapped_File& = delete;
+
+            auto data() const -> char const* { return data_; }
+            auto size() const -> std::size_t { return size_; }
+
+        private:
+            char const* data_{};
+            std::size_t size_{};
+        };
+    }
+}
+
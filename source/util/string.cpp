@@ -1,8 +1,9 @@
 #include "string.hpp"
-#include <nonstd/optional.hpp>
 #include <fmt/format.hpp>
-#include <iomanip>
-#include <sstream>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 namespace cctt
 {
@@ -15,57 +16,197 @@ namespace cctt
                 return ('\x21' <= ch && ch <= '\x7e');
             }
 
-            template <class Replace>
-            auto replace_char_in_place(std::string& haystack, Replace&& replace)
+            // Characters that std::quoted() escapes with a backslash.
+            auto is_quoting(char ch) -> bool
+            {
+                return (ch == '"' || ch == '\\');
+            }
+
+            auto needs_json_escape(char ch) -> bool
+            {
+                return (static_cast<unsigned char>(ch) < 0x20 || ch == '"' || ch == '\\');
+            }
+
+            template <std::size_t len>
+            auto append_literal(fmt::memory_buffer& out, char const (&text)[len]) -> void
+            {
+                out.append(text, text + len - 1);
+            }
+
+            // The following find_*() return the first character in [first, last)
+            // that cannot be copied verbatim, or last if there is none.
+            //
+            // With SSE2, 16 characters are tested at a time.
+
+            auto find_non_printable(char const* first, char const* last) -> char const*
+            {
+                #ifdef __SSE2__
+                    // As signed bytes: 0x20 < ch < 0x7f
+                    auto const space = _mm_set1_epi8(0x20);
+                    auto const del = _mm_set1_epi8(0x7f);
+
+                    for (; last - first >= 16; first += 16) {
+                        auto chunk = _mm_loadu_si128(reinterpret_cast<__m128i const*>(first));
+                        auto is_printable = _mm_and_si128(_mm_cmpgt_epi8(chunk, space), _mm_cmplt_epi8(chunk, del));
+                        auto mask = unsigned(_mm_movemask_epi8(is_printable)) ^ 0xffffu;
+                        if (mask != 0) return first + __builtin_ctz(mask);
+                    }
+                #endif
+
+                for (; first < last; first++)
+                    if (!is_printable_in_ascii(*first))
+                        return first;
+
+                return last;
+            }
+
+            auto find_non_printable_or_quoting(char const* first, char const* last) -> char const*
+            {
+                #ifdef __SSE2__
+                    // As signed bytes: 0x20 < ch < 0x7f && ch != '"' && ch != '\\'
+                    auto const space = _mm_set1_epi8(0x20);
+                    auto const del = _mm_set1_epi8(0x7f);
+                    auto const quote = _mm_set1_epi8('"');
+                    auto const backslash = _mm_set1_epi8('\\');
+
+                    for (; last - first >= 16; first += 16) {
+                        auto chunk = _mm_loadu_si128(reinterpret_cast<__m128i const*>(first));
+                        auto is_printable = _mm_and_si128(_mm_cmpgt_epi8(chunk, space), _mm_cmplt_epi8(chunk, del));
+                        auto is_quoting = _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash));
+                        auto is_plain = _mm_andnot_si128(is_quoting, is_printable);
+                        auto mask = unsigned(_mm_movemask_epi8(is_plain)) ^ 0xffffu;
+                        if (mask != 0) return first + __builtin_ctz(mask);
+                    }
+                #endif
+
+                for (; first < last; first++)
+                    if (!is_printable_in_ascii(*first) || is_quoting(*first))
+                        return first;
+
+                return last;
+            }
+
+            auto find_json_escape(char const* first, char const* last) -> char const*
             {
-                for (auto pos = std::string::size_type(0); pos < haystack.size(); ) {
-                    if (auto replacement = replace(haystack[pos])) {
-                        haystack.replace(pos, 1, *replacement);
-                        pos += replacement->size();
-                    } else {
-                        pos++;
+                #ifdef __SSE2__
+                    // ch <= 0x1f || ch == '"' || ch == '\\'
+                    auto const control_max = _mm_set1_epi8(0x1f);
+                    auto const quote = _mm_set1_epi8('"');
+                    auto const backslash = _mm_set1_epi8('\\');
+
+                    for (; last - first >= 16; first += 16) {
+                        auto chunk = _mm_loadu_si128(reinterpret_cast<__m128i const*>(first));
+                        auto is_control = _mm_cmpeq_epi8(_mm_max_epu8(chunk, control_max), control_max);
+                        auto is_quote = _mm_cmpeq_epi8(chunk, quote);
+                        auto is_backslash = _mm_cmpeq_epi8(chunk, backslash);
+                        auto mask = _mm_movemask_epi8(_mm_or_si128(is_control, _mm_or_si128(is_quote, is_backslash)));
+                        if (mask != 0) return first + __builtin_ctz(unsigned(mask));
                     }
+                #endif
+
+                for (; first < last; first++)
+                    if (needs_json_escape(*first))
+                        return first;
+
+                return last;
+            }
+
+            // Assumes: ch is not printable.
+            auto append_non_printable(fmt::memory_buffer& out, char ch) -> void
+            {
+                switch (ch) {
+                    case '\x20': append_literal(out, "␣"); break;
+                    case '\t': append_literal(out, "\\t"); break;
+                    case '\n': append_literal(out, "\\n"); break;
+                    case '\r': append_literal(out, "\\r"); break;
+                    case '\f': append_literal(out, "\\f"); break;
+                    case '\v': append_literal(out, "\\v"); break;
+                    default: fmt::format_to(out, "\\x{:02x}", ch); break;
                 }
             }
+
+            auto to_string(fmt::memory_buffer const& buf) -> std::string
+            {
+                return {buf.data(), buf.size()};
+            }
         }
 
         auto quote(std::string const& x) -> std::string
         {
-            std::ostringstream oss;
-            oss << std::quoted(x);
-            auto result = oss.str();
-
-            return format_to_oneline(std::move(result));
+            fmt::memory_buffer out;
+            append_quoted(out, x.data(), x.data() + x.size());
+            return to_string(out);
         }
 
         auto quote_without_delimiters(std::string const& x) -> std::string
         {
-            auto quoted = quote(x);
-            return quoted.substr(1, quoted.size() - 2);
+            fmt::memory_buffer out;
+            append_quoted_without_delimiters(out, x.data(), x.data() + x.size());
+            return to_string(out);
         }
 
         auto format_to_oneline(std::string x) -> std::string
         {
-            replace_char_in_place(
-                x,
-                [] (char ch) -> nonstd::optional<std::string> {
-                    if (is_printable_in_ascii(ch)) {
-                        return {};
-                    } else {
-                        switch (ch) {
-                            case '\x20': return std::string{"␣"};
-                            case '\t': return std::string{"\\t"};
-                            case '\n': return std::string{"\\n"};
-                            case '\r': return std::string{"\\r"};
-                            case '\f': return std::string{"\\f"};
-                            case '\v': return std::string{"\\v"};
-                            default: return fmt::format("\\x{:02x}", ch);
-                        }
-                    }
+            fmt::memory_buffer out;
+            append_oneline(out, x.data(), x.data() + x.size());
+            return to_string(out);
+        }
+
+        auto append_quoted(fmt::memory_buffer& out, char const* first, char const* last) -> void
+        {
+            out.push_back('"');
+            append_quoted_without_delimiters(out, first, last);
+            out.push_back('"');
+        }
+
+        auto append_quoted_without_delimiters(fmt::memory_buffer& out, char const* first, char const* last) -> void
+        {
+            while (first < last) {
+                auto special = find_non_printable_or_quoting(first, last);
+                out.append(first, special);
+                if (special == last) break;
+
+                if (is_quoting(*special)) {
+                    out.push_back('\\');
+                    out.push_back(*special);
+                } else {
+                    append_non_printable(out, *special);
+                }
+
+                first = special + 1;
+            }
+        }
+
+        auto append_oneline(fmt::memory_buffer& out, char const* first, char const* last) -> void
+        {
+            while (first < last) {
+                auto special = find_non_printable(first, last);
+                out.append(first, special);
+                if (special == last) break;
+
+                append_non_printable(out, *special);
+                first = special + 1;
+            }
+        }
+
+        auto append_json_escaped(fmt::memory_buffer& out, char const* first, char const* last) -> void
+        {
+            while (first < last) {
+                auto special = find_json_escape(first, last);
+                out.append(first, special);
+                if (special == last) break;
+
+                switch (*special) {
+                    case '"': append_literal(out, "\\\""); break;
+                    case '\\': append_literal(out, "\\\\"); break;
+                    case '\n': append_literal(out, "\\n"); break;
+                    case '\r': append_literal(out, "\\r"); break;
+                    case '\t': append_literal(out, "\\t"); break;
+                    default: fmt::format_to(out, "\\u{:04x}", unsigned(static_cast<unsigned char>(*special))); break;
                 }
-            );
 
-            return x;
+                first = special + 1;
+            }
         }
     }
 }
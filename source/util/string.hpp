@@ -1,4 +1,5 @@
 #pragma once
+#include <fmt/format.hpp>
 #include <string>
 
 namespace cctt
@@ -8,6 +9,15 @@ namespace cctt
         auto quote(std::string const& x) -> std::string;
         auto quote_without_delimiters(std::string const& x) -> std::string;
         auto format_to_oneline(std::string x) -> std::string;
+
+        // Same as above, but append to out in a single pass.
+        auto append_quoted(fmt::memory_buffer& out, char const* first, char const* last) -> void;
+        auto append_quoted_without_delimiters(fmt::memory_buffer& out, char const* first, char const* last) -> void;
+        auto append_oneline(fmt::memory_buffer& out, char const* first, char const* last) -> void;
+
+        // Append [first, last) to out as the content of a JSON string (without the delimiting quotes).
+        // Bytes outside of ASCII are copied verbatim.
+        auto append_json_escaped(fmt::memory_buffer& out, char const* first, char const* last) -> void;
     }
 }
 